@@ -7,6 +7,7 @@
 #include "io.hpp"
 #include "ml.hpp"
 #include "numpy.hpp"
+#include "parallel.h"
 #include "timer.hpp"
 
 using namespace std;
@@ -43,6 +44,7 @@ try {
     const bool isSubset = true;
     const size_t interval_begin = 0, interval_end = n;
     cout << "slots: " << n << '\n';
+    cout << "threads: " << parallel::threads() << '\n';
 
     const size_t sbit = 6;
     const size_t ibit = sbit, w1bit = sbit, w4bit = sbit, w8bit = sbit;
@@ -125,11 +127,18 @@ try {
 
     std::cout << "# native copy = " << nativeCopyCounter << '\n';
 #if (TEMPLATE==8)
-    std::cout << "# ciphertexts = " << smart::Wrapper::getManager().getCounter() << '\n';
-    std::cout << "cache entries = " << smart::Wrapper::getCache().size()         << '\n';
-    std::cout << " # cache hits = " << smart::Wrapper::getCache().getHits()      << '\n';
-    std::cout << " # cache miss = " << smart::Wrapper::getCache().getMisses()    << '\n';
-    std::cout << " # cache reqs = " << smart::Wrapper::getCache().getRequests()  << '\n';
+    for (int c = 1; c <= smart::Wrapper::nContexts(); c++)
+    {
+        auto & cache = smart::Wrapper::getCache(c);
+        std::cout << "key context " << c << ":\n";
+        std::cout << "# ciphertexts = " << smart::Wrapper::getManager(c).getCounter() << '\n';
+        std::cout << "cache entries = " << cache.size()         << '\n';
+        std::cout << " # cache hits = " << cache.getHits()      << '\n';
+        std::cout << " # spill hits = " << cache.getSpillHits() << '\n';
+        std::cout << " # cache miss = " << cache.getMisses()    << '\n';
+        std::cout << " # cache reqs = " << cache.getRequests()  << '\n';
+    }
+    std::cout << "native allocs = " << smart::arena::stats().allocations  << '\n';
 #endif
 
     print( Ciphertext::getCounters() );
@@ -8,6 +8,10 @@
     #define POLYNOMIAL_DEGREE 8192
 #endif
 
+#ifndef RESIDUE_PARALLEL
+    #define RESIDUE_PARALLEL 0
+#endif
+
 using namespace crypto;
 using namespace seal_wrapper;
 using std::string;
@@ -21,7 +25,8 @@ class CRT
 
         static vector<uint64_t> coprimes;
         static Number mod;
-        static vector<Number> nx;
+        static vector<vector<uint64_t>> garner; // [i][j]: inverse of coprime j modulo coprime i
+        static vector<Number> radix; // product of the coprimes before each one
         static std::shared_ptr<CRT<Number>> zero;
         static vector<std::shared_ptr<Ct>> p_zeros;
         static vector<std::shared_ptr<SealBFVKeys>> keys;
@@ -36,14 +41,21 @@ class CRT
         void encrypt(const vector<Number> &);
         void encrypt(const vector<vector<uint64_t>> &);
 
+        static vector<Ciphertext> wrap(vector<Ct> &&);
+        template <class F> static void forEachResidue(const F &);
+
     public:
         CRT() : CRT( Number(0) ) {}
         CRT(const CRT &);
+        CRT(CRT &&) = default;
         CRT(const Number &, bool=false);
         CRT(const vector<Ciphertext> &);
+        CRT(vector<Ciphertext> &&);
         CRT(const vector<Number> &, bool=false);
         CRT(const vector<vector<uint64_t>> &);
 
+        CRT & operator=(const CRT &) = default;
+        CRT & operator=(CRT &&) = default;
         CRT & operator+=(const CRT &);
         CRT & operator*=(const CRT &);
         CRT & operator-=(const CRT &);
@@ -64,19 +76,26 @@ class CRT
         template <class T> friend CRT operator-(const T &, const CRT<T> &);
 
         vector<Number> decode(bool sign=true) const;
+#if (TEMPLATE == 0 || (TEMPLATE == 8 && CTADD == 0))
+        static CRT add_many(const vector<const CRT *> &);
+#endif
         static void clearCache();
         static vector<Number> decode(const CRT &, bool sign=true);
+        static void decode(const vector<const CRT *> &, Number * out, bool sign=true);
         static CRT encode(const Number &);
         static CRT encode(const vector<Number> &);
+        static vector<vector<CRT>> encryptPacked(const vector<const vector<Number> *> &);
         static vector<uint64_t> getCoprimes();
         static string getCounters();
         static void resetCounters();
         static void resizeCache(size_t size);
         static void setCoprimes(const vector<uint64_t> &, int n=POLYNOMIAL_DEGREE);
         static size_t slots();
+        static void trimCache();
         string str() const;
 
         template <class T> friend std::ostream & operator<<(std::ostream &, const CRT<T> &);
+        template <class T> friend void relinearize(CRT<T> &);
 };
 
 #include "crt_smartwrapper.hpp"
@@ -13,7 +13,8 @@
 
 template <class Number> vector<uint64_t> CRT<Number>::coprimes;
 template <class Number> Number CRT<Number>::mod = 2;
-template <class Number> vector<Number> CRT<Number>::nx;
+template <class Number> vector<vector<uint64_t>> CRT<Number>::garner;
+template <class Number> vector<Number> CRT<Number>::radix;
 template <class Number> std::shared_ptr<CRT<Number>> CRT<Number>::zero;
 template <class Number> vector<std::shared_ptr<Ct>> CRT<Number>::p_zeros;
 template <class Number> vector<std::shared_ptr<SealBFVKeys>> CRT<Number>::keys;
@@ -32,6 +33,19 @@ inline T reduce(const T & a, const U & mod)
     return r;
 }
 
+// inverse of a modulo m, for a and m coprime
+inline uint64_t modInverse(uint64_t a, uint64_t m)
+{
+    int64_t r0 = m, r1 = a % m, x0 = 0, x1 = 1;
+    while (r1)
+    {
+        auto q = r0 / r1;
+        std::swap( r0 -= q * r1, r1 );
+        std::swap( x0 -= q * x1, x1 );
+    }
+    return x0 < 0 ? x0 + m : x0;
+}
+
 // constructors
 
 template <class Number>
@@ -51,6 +65,11 @@ CRT<Number>::CRT(const vector<Ciphertext> & a)
     v = a;
 }
 
+template <class Number>
+CRT<Number>::CRT(vector<Ciphertext> && a)
+    : v( std::move(a) )
+{}
+
 template <class Number>
 CRT<Number>::CRT(const vector<Number> & a, bool dummy)
 {
@@ -68,24 +87,21 @@ CRT<Number>::CRT(const vector<vector<uint64_t>> & a)
 template <class Number>
 CRT<Number> & CRT<Number>::operator+=(const CRT & a)
 {
-    for (int i=0; i<coprimes.size(); i++)
-        v[i] += a.v[i];
+    forEachResidue( [&](size_t i) { v[i] += a.v[i]; } );
     return *this;
 }
 
 template <class Number>
 CRT<Number> & CRT<Number>::operator*=(const CRT & a)
 {
-    for (int i=0; i<coprimes.size(); i++)
-        v[i] *= a.v[i];
+    forEachResidue( [&](size_t i) { v[i] *= a.v[i]; } );
     return *this;
 }
 
 template <class Number>
 CRT<Number> & CRT<Number>::operator-=(const CRT & a)
 {
-    for (int i=0; i<coprimes.size(); i++)
-        v[i] -= a.v[i];
+    forEachResidue( [&](size_t i) { v[i] -= a.v[i]; } );
     return *this;
 }
 
@@ -93,8 +109,7 @@ template <class Number>
 CRT<Number> & CRT<Number>::operator+=(const Number & a)
 {
     auto b = reduce(a, mod);
-    for (int i=0; i<coprimes.size(); i++)
-        v[i] += (int) reduce(b, coprimes[i]);
+    forEachResidue( [&](size_t i) { v[i] += (int) reduce(b, coprimes[i]); } );
     return *this;
 }
 
@@ -102,8 +117,7 @@ template <class Number>
 CRT<Number> & CRT<Number>::operator*=(const Number & a)
 {
     auto b = reduce(a, mod);
-    for (int i=0; i<coprimes.size(); i++)
-        v[i] *= (int) reduce(b, coprimes[i]);
+    forEachResidue( [&](size_t i) { v[i] *= (int) reduce(b, coprimes[i]); } );
     return *this;
 }
 
@@ -111,8 +125,7 @@ template <class Number>
 CRT<Number> & CRT<Number>::operator-=(const Number & a)
 {
     auto b = reduce(a, mod);
-    for (int i=0; i<coprimes.size(); i++)
-        v[i] -= (int) reduce(b, coprimes[i]);
+    forEachResidue( [&](size_t i) { v[i] -= (int) reduce(b, coprimes[i]); } );
     return *this;
 }
 
@@ -125,58 +138,52 @@ CRT<Number> CRT<Number>::operator-() const
 template <class Number>
 CRT<Number> CRT<Number>::operator+(const CRT & a) const
 {
-    vector<Ciphertext> vc;
-    for (int i=0; i<coprimes.size(); i++)
-        vc.push_back( v[i] + a.v[i] );
-    return CRT<Number>(vc);
+    vector<Ciphertext> vc( coprimes.size() );
+    forEachResidue( [&](size_t i) { vc[i] = v[i] + a.v[i]; } );
+    return CRT<Number>( std::move(vc) );
 }
 
 template <class Number>
 CRT<Number> CRT<Number>::operator*(const CRT & a) const
 {
-    vector<Ciphertext> vc;
-    for (int i=0; i<coprimes.size(); i++)
-        vc.push_back( v[i] * a.v[i] );
-    return CRT<Number>(vc);
+    vector<Ciphertext> vc( coprimes.size() );
+    forEachResidue( [&](size_t i) { vc[i] = v[i] * a.v[i]; } );
+    return CRT<Number>( std::move(vc) );
 }
 
 template <class Number>
 CRT<Number> CRT<Number>::operator-(const CRT & a) const
 {
-    vector<Ciphertext> vc;
-    for (int i=0; i<coprimes.size(); i++)
-        vc.push_back( v[i] - a.v[i] );
-    return CRT<Number>(vc);
+    vector<Ciphertext> vc( coprimes.size() );
+    forEachResidue( [&](size_t i) { vc[i] = v[i] - a.v[i]; } );
+    return CRT<Number>( std::move(vc) );
 }
 
 template <class Number>
 CRT<Number> CRT<Number>::operator+(const Number & a) const
 {
     auto b = reduce(a, mod);
-    vector<Ciphertext> vc;
-    for (int i=0; i<coprimes.size(); i++)
-        vc.push_back( v[i] + (int) reduce(b, coprimes[i]) );
-    return CRT<Number>(vc);
+    vector<Ciphertext> vc( coprimes.size() );
+    forEachResidue( [&](size_t i) { vc[i] = v[i] + (int) reduce(b, coprimes[i]); } );
+    return CRT<Number>( std::move(vc) );
 }
 
 template <class Number>
 CRT<Number> CRT<Number>::operator*(const Number & a) const
 {
     auto b = reduce(a, mod);
-    vector<Ciphertext> vc;
-    for (int i=0; i<coprimes.size(); i++)
-        vc.push_back( v[i] * (int) reduce(b, coprimes[i]) );
-    return CRT<Number>(vc);
+    vector<Ciphertext> vc( coprimes.size() );
+    forEachResidue( [&](size_t i) { vc[i] = v[i] * (int) reduce(b, coprimes[i]); } );
+    return CRT<Number>( std::move(vc) );
 }
 
 template <class Number>
 CRT<Number> CRT<Number>::operator-(const Number & a) const
 {
     auto b = reduce(a, mod);
-    vector<Ciphertext> vc;
-    for (int i=0; i<coprimes.size(); i++)
-        vc.push_back( v[i] - (int) reduce(b, coprimes[i]) );
-    return CRT<Number>(vc);
+    vector<Ciphertext> vc( coprimes.size() );
+    forEachResidue( [&](size_t i) { vc[i] = v[i] - (int) reduce(b, coprimes[i]); } );
+    return CRT<Number>( std::move(vc) );
 }
 
 template <class Number>
@@ -199,6 +206,21 @@ CRT<Number> operator-(const Number & a, const CRT<Number> & b)
 
 // functions
 
+#if (TEMPLATE == 0 || (TEMPLATE == 8 && CTADD == 0))
+template <class Number>
+CRT<Number> CRT<Number>::add_many(const vector<const CRT *> & v)
+{
+    vector<Ciphertext> vc( coprimes.size() );
+    forEachResidue( [&](size_t i)
+    {
+        vector<const Ciphertext *> residues;
+        for (auto a : v) residues.push_back( &a->v[i] );
+        vc[i] = Ciphertext::add_many(residues);
+    });
+    return CRT<Number>( std::move(vc) );
+}
+#endif
+
 template <class Number>
 void CRT<Number>::clearCache()
 {
@@ -207,6 +229,26 @@ void CRT<Number>::clearCache()
 #endif
 }
 
+// Runs f(i) for every residue i. With RESIDUE_PARALLEL=1 the residues of an
+// operation called outside the thread pool are dispatched to it. Residue i is
+// queued to worker i modulo the pool size, a locality hint only: idle workers
+// steal, and with fewer workers than coprimes several residues share a queue.
+// Calls from the workers, e.g. inside the parallel layers, already have their
+// cores busy and run the residues inline.
+template <class Number>
+template <class F>
+void CRT<Number>::forEachResidue(const F & f)
+{
+#if (RESIDUE_PARALLEL == 1)
+    if ( parallel::ThreadPool::workerIndex() < 0 )
+    {
+        parallel::run( coprimes.size(), f, [](size_t i) { return i; } );
+        return;
+    }
+#endif
+    for ( size_t i=0; i<coprimes.size(); i++ ) f(i);
+}
+
 template <class Number>
 vector<Number> CRT<Number>::decode(bool sign) const
 {
@@ -216,28 +258,48 @@ vector<Number> CRT<Number>::decode(bool sign) const
 template <class Number>
 vector<Number> CRT<Number>::decode(const CRT<Number> & a, bool sign)
 {
-    vector<vector<int>> vp;
-    for ( const auto & ct : a.v )
-        vp.push_back( vector<int>(Ct(ct)) );
+    vector<Number> r( slots() );
+    decode({&a}, r.data(), sign);
+    return r;
+}
 
-    auto size = coprimes.size();
-    auto nSlots = slots();
-    vector<vector<Number>> vf( nSlots, vector<Number>(size) );
-    for ( int i=0; i<size; i++ )
-        for ( int j=0; j<nSlots; j++ )
-            vf[j][i] = vp[i][j] * nx[i] % mod;
-
-    vector<Number> vr;
-    for ( auto & f : vf )
+// Decrypts the residues of all the numbers side by side, then recombines the
+// slots of each number with Garner's algorithm: the mixed-radix digits are
+// computed over all the slots in 64-bit arithmetic and only their weighted
+// sum in Number. The slots of number k go to out[k * slots()] onwards.
+template <class Number>
+void CRT<Number>::decode(const vector<const CRT<Number> *> & a, Number * out, bool sign)
+{
+    auto size = coprimes.size(), n = slots();
+    vector<vector<uint64_t>> residues( a.size() * size );
+    parallel::run( residues.size(), [&](size_t k)
     {
-        Number r = 0;
-        for ( auto & e : f ) r += e;
-        r %= mod;
-        r = (sign && r>mod/2) ? r-mod : r;
-        vr.push_back(r);
-    }
+        residues[k] = vector<uint64_t>( Ct( a[k / size]->v[k % size] ) );
+    });
 
-    return vr;
+    parallel::run( a.size(), [&](size_t c)
+    {
+        auto digits = &residues[c * size];
+        for ( size_t i=1; i<size; i++ )
+        {
+            auto m = coprimes[i];
+            auto * x = digits[i].data();
+            for ( size_t j=0; j<i; j++ )
+            {
+                auto g = garner[i][j];
+                const auto * y = digits[j].data();
+                for ( size_t s=0; s<n; s++ ) x[s] = (x[s] + m - y[s] % m) * g % m;
+            }
+        }
+
+        auto r = out + c * n;
+        for ( size_t s=0; s<n; s++ )
+        {
+            Number e = 0;
+            for ( size_t i=0; i<size; i++ ) e += Number( digits[i][s] ) * radix[i];
+            r[s] = (sign && e > mod/2) ? e - mod : e;
+        }
+    });
 }
 
 template <class Number>
@@ -260,26 +322,60 @@ void CRT<Number>::encrypt(const Number & a)
     encrypt(tmp);
 }
 
+// the residues of each coprime are computed and encrypted on their own
 template <class Number>
 void CRT<Number>::encrypt(const vector<Number> & a)
 {
     auto size = coprimes.size();
-    vector<vector<uint64_t>> m(size);
-    for ( const auto & e : a )
+    vector<vector<uint64_t>> m( size, vector<uint64_t>( a.size() ) );
+    parallel::run( size, [&](size_t i)
     {
-        auto n = e % mod;
-        n = n<0 ? mod+n : n;
-        for ( int i=0; i<size; i++ )
-            m[i].push_back( n % coprimes[i] );
-    }
+        for ( size_t j=0; j<a.size(); j++ )
+            m[i][j] = uint64_t( reduce(a[j], mod) % coprimes[i] );
+    });
     encrypt(m);
 }
 
 template <class Number>
 void CRT<Number>::encrypt(const vector<vector<uint64_t>> & a)
 {
-    for ( int i=0; i<coprimes.size(); i++ )
-        v.push_back( SMART_CONSTRUCTOR( Ct(a[i], keys[i]), coprimes[i], p_zeros[i] ) );
+    vector<Ct> natives( coprimes.size() );
+    parallel::run( coprimes.size(), [&](size_t i) { natives[i] = Ct(a[i], keys[i]); } );
+    v = wrap( std::move(natives) );
+}
+
+// Encrypts each vector packed into as many CRT numbers as it fills, the last
+// one padded with zeros. The residues of all the vectors are encrypted side
+// by side and registered in one go.
+template <class Number>
+vector<vector<CRT<Number>>> CRT<Number>::encryptPacked(const vector<const vector<Number> *> & a)
+{
+    auto n = slots(), size = coprimes.size();
+    vector<std::pair<size_t, size_t>> chunks; // vector and first slot
+    for ( size_t l=0; l<a.size(); l++ )
+        for ( size_t o=0; o<a[l]->size(); o+=n ) chunks.emplace_back(l, o);
+
+    vector<Ct> natives( chunks.size() * size );
+    parallel::run( natives.size(), [&](size_t k)
+    {
+        auto i = k % size;
+        const auto & e = *a[ chunks[k / size].first ];
+        auto o = chunks[k / size].second;
+        vector<uint64_t> m(n, 0);
+        for ( size_t j=0; j<n && o+j<e.size(); j++ )
+            m[j] = uint64_t( reduce(e[o+j], mod) % coprimes[i] );
+        natives[k] = Ct(m, keys[i]);
+    });
+    auto cts = wrap( std::move(natives) );
+
+    vector<vector<CRT<Number>>> r( a.size() );
+    auto it = std::make_move_iterator( cts.begin() );
+    for ( auto & chunk : chunks )
+    {
+        r[chunk.first].push_back( CRT<Number>( vector<Ciphertext>(it, it + size) ) );
+        it += size;
+    }
+    return r;
 }
 
 template <class Number>
@@ -313,24 +409,38 @@ void CRT<Number>::resizeCache(size_t size)
 #endif
 }
 
+template <class Number>
+void CRT<Number>::trimCache()
+{
+#if (TEMPLATE==8)
+    Ciphertext::trimCache();
+#endif
+}
+
 template <class Number>
 void CRT<Number>::setCoprimes(const vector<uint64_t> & coprimes, int n)
 {
     CRT<Number>::coprimes = coprimes;
 
+    // the key sets of the coprimes are independent, so they are opened (or
+    // generated) side by side
+    vector<SealBFVKeys> sets( coprimes.size() );
+    parallel::run( coprimes.size(), [&](size_t i) { sets[i] = SealBFVKeys::openKeys(n, coprimes[i]); } );
+
     mod = 1;
     keys.clear();
     vector<Ciphertext> vzero;
-    for ( const auto & t : coprimes )
+    for ( size_t i=0; i<coprimes.size(); i++ )
     {
+        auto t = coprimes[i];
         mod *= t;
-        auto key = SealBFVKeys(n,t);
-        keys.push_back( std::make_shared<SealBFVKeys>(key) );
+        const auto & key = sets[i];
+        keys.push_back( SealBFVKeys::share(key) );
         auto ct_zero = Ct(0,key);
         p_zeros.push_back( std::make_shared<Ct>(ct_zero) );
 #if (TEMPLATE == 8)
-        int kid = (uint64_t) keys.back().get();
-        vzero.push_back( Ciphertext(ct_zero, kid) );
+        // each coprime gets its own manager, OOM table and zero
+        vzero.push_back( Ciphertext::makeZero(ct_zero) );
 #else
         vzero.push_back( SMART_CONSTRUCTOR(ct_zero, t, p_zeros.back()) );
         // vzero.push_back( SMART_CONSTRUCTOR(p_zeros.back(), t, p_zeros.back()) );
@@ -338,13 +448,15 @@ void CRT<Number>::setCoprimes(const vector<uint64_t> & coprimes, int n)
     }
     zero = std::make_shared<CRT<Number>>(vzero);
 
-    nx.clear();
-    for ( const auto & t : coprimes )
+    // constants of Garner's algorithm
+    garner.assign( coprimes.size(), {} );
+    radix.clear();
+    Number product = 1;
+    for ( size_t i=0; i<coprimes.size(); i++ )
     {
-        Number ni = mod / t;
-        Number nxi;
-        for ( uint64_t xi=0; (nxi = xi * ni) % t != 1; xi++ );
-        nx.push_back(nxi);
+        for ( size_t j=0; j<i; j++ ) garner[i].push_back( modInverse(coprimes[j], coprimes[i]) );
+        radix.push_back(product);
+        product *= coprimes[i];
     }
 }
 
@@ -367,8 +479,34 @@ string CRT<Number>::str() const
     return s;
 }
 
+// wraps residue ciphertexts, natives[k] being of coprime k % coprimes.size()
+template <class Number>
+vector<Ciphertext> CRT<Number>::wrap(vector<Ct> && natives)
+{
+#if (TEMPLATE == 8)
+    return Ciphertext::wrap( std::move(natives) );
+#else
+    vector<Ciphertext> r;
+    r.reserve( natives.size() );
+    for ( size_t k=0; k<natives.size(); k++ )
+    {
+        auto i = k % coprimes.size();
+        r.push_back( SMART_CONSTRUCTOR( std::move(natives[k]), coprimes[i], p_zeros[i] ) );
+    }
+    return r;
+#endif
+}
+
 template <class Number>
 std::ostream & operator<<(std::ostream & os, const CRT<Number> & a)
 {
     return os << a.str();
 }
+
+template <class Number>
+void relinearize(CRT<Number> & a)
+{
+#if (TEMPLATE == 0 || TEMPLATE == 8)
+    CRT<Number>::forEachResidue( [&](size_t i) { relinearize(a.v[i]); } );
+#endif
+}
@@ -1,10 +1,21 @@
 #pragma once
 
 #include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "parallel.h"
 
 using std::cout;
 using std::getline;
@@ -49,29 +60,243 @@ vector<string> trim(const vector<string> & v)
     return vout;
 }
 
+// A whole file mapped read-only.
+class MappedFile
+{
+    private:
+        const char * data = nullptr;
+        size_t length = 0;
+
+    public:
+        explicit MappedFile(const string & filename)
+        {
+            int fd = open( filename.c_str(), O_RDONLY );
+            if ( fd < 0 ) throw "Cannot open " + filename;
+            struct stat st;
+            if ( fstat(fd, &st) == 0 ) length = st.st_size;
+            if ( length )
+            {
+                void * p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if ( p != MAP_FAILED ) data = static_cast<const char *>(p);
+            }
+            close(fd);
+            if ( length && !data ) throw "Cannot map " + filename;
+        }
+        MappedFile(MappedFile && f) : data(f.data), length(f.length) { f.data = nullptr; f.length = 0; }
+        MappedFile(const MappedFile &) = delete;
+        ~MappedFile() { if (data) munmap( const_cast<char *>(data), length ); }
+
+        const char * begin() const { return data; }
+        const char * end() const { return data + length; }
+        size_t size() const { return length; }
+};
+
+// An array in NumPy's .npy format, little-endian and in C order, read in
+// place from the mapped file. view<U>() exposes the values as U when that is
+// their type, and is null otherwise; get<T>(i) converts any of them.
+class NpyArray
+{
+    private:
+        MappedFile file;
+        const char * values = nullptr;
+        char kind = 0; // 'f', 'i' or 'u'
+        size_t width = 0; // bytes per value
+        vector<size_t> dims;
+        size_t count = 1;
+
+        // the value of key in the header dictionary
+        static string field(const string & header, const string & key)
+        {
+            auto p = header.find("'" + key + "'");
+            if ( p == string::npos ) throw "The .npy header has no " + key;
+            p = header.find(':', p) + 1;
+            while ( p < header.size() && std::isspace(header[p]) ) p++;
+            char close = header[p] == '(' ? ')' : header[p] == '\'' ? '\'' : ',';
+            auto q = header.find(close, p + 1);
+            return header.substr(p + (close != ','), q - p - (close != ','));
+        }
+
+    public:
+        static bool is(const MappedFile & f)
+        {
+            return f.size() >= 10 && std::memcmp(f.begin(), "\x93NUMPY", 6) == 0;
+        }
+
+        explicit NpyArray(MappedFile && f) : file( std::move(f) )
+        {
+            if ( !is(file) ) throw string("Not a .npy file");
+            auto p = reinterpret_cast<const unsigned char *>( file.begin() );
+            size_t start = 10, length = p[8] | p[9] << 8;
+            if ( p[6] >= 2 )
+            {
+                if ( file.size() < 12 ) throw string("Truncated .npy header");
+                start = 12;
+                length |= size_t(p[10]) << 16 | size_t(p[11]) << 24;
+            }
+            if ( start + length > file.size() ) throw string("Truncated .npy header");
+            string header(file.begin() + start, length);
+
+            auto descr = field(header, "descr");
+            if ( descr.size() < 3 || (descr[0] == '>' && descr[2] != '1') ) throw "Unsupported .npy type " + descr;
+            kind = descr[1];
+            width = std::stoul( descr.substr(2) );
+            bool known = (kind == 'f' && (width == 4 || width == 8))
+                || ((kind == 'i' || kind == 'u') && (width == 1 || width == 2 || width == 4 || width == 8));
+            if ( !known ) throw "Unsupported .npy type " + descr;
+            if ( field(header, "fortran_order").rfind("True", 0) == 0 ) throw string("Fortran-ordered .npy files are not supported");
+
+            auto shape = field(header, "shape");
+            for ( const char * c = shape.c_str(); *c; )
+            {
+                char * e;
+                auto d = std::strtoull(c, &e, 10);
+                if ( e == c ) { c++; continue; }
+                dims.push_back(d);
+                count *= d;
+                c = e;
+            }
+            values = file.begin() + start + length;
+            if ( values + count * width > file.end() ) throw string("Truncated .npy data");
+        }
+
+        template <class T> T get(size_t i) const
+        {
+            const char * v = values + i * width;
+            auto read = [v](auto x) { std::memcpy(&x, v, sizeof x); return T(x); };
+            switch ( kind == 'f' ? -int(width) : kind == 'i' ? int(width) : 16 + int(width) )
+            {
+                case -4: return read( float() );
+                case -8: return read( double() );
+                case 1: return read( int8_t() );
+                case 2: return read( int16_t() );
+                case 4: return read( int32_t() );
+                case 8: return read( int64_t() );
+                case 17: return read( uint8_t() );
+                case 18: return read( uint16_t() );
+                case 20: return read( uint32_t() );
+                default: return read( uint64_t() );
+            }
+        }
+
+        const vector<size_t> & shape() const { return dims; }
+        size_t size() const { return count; }
+
+        template <class U> const U * view() const
+        {
+            if ( !std::is_arithmetic<U>::value ) return nullptr;
+            char k = std::is_floating_point<U>::value ? 'f' : std::is_signed<U>::value ? 'i' : 'u';
+            if ( k != kind || sizeof(U) != width ) return nullptr;
+            return reinterpret_cast<const U *>(values);
+        }
+};
+
+// Calls f(begin, end) on about equal ranges of [0, n), one per task.
+template <class F> void
+forRanges(size_t n, const F & f)
+{
+    size_t tasks = std::min( n, 4 * parallel::threads() );
+    parallel::run(tasks, [&](size_t t) { f(n * t / tasks, n * (t + 1) / tasks); });
+}
+
+// Lines of a text file, without blank ones.
+inline vector<std::pair<const char *, const char *>>
+lines(const MappedFile & file)
+{
+    vector<std::pair<const char *, const char *>> v;
+    for ( const char * p = file.begin(); p < file.end(); )
+    {
+        auto q = static_cast<const char *>( std::memchr(p, '\n', file.end() - p) );
+        if (!q) q = file.end();
+        if ( std::find_if(p, q, [](char c) { return !std::isspace(c); }) != q ) v.emplace_back(p, q);
+        p = q + 1;
+    }
+    return v;
+}
+
+// Parses the delimited numbers in [p, end) into row, in place.
+template <class T> void
+parseLine(const char * p, const char * end, char delimiter, vector<T> & row)
+{
+    row.reserve( std::count(p, end, delimiter) + 1 );
+    for (;;)
+    {
+        while ( p < end && std::isspace(*p) && *p != delimiter ) p++;
+        if ( p < end && *p == '+' ) p++;
+        double x;
+        auto r = std::from_chars(p, end, x);
+        if ( r.ec != std::errc() ) throw string("Invalid number: ") + string( p, std::find(p, end, delimiter) );
+        row.push_back( T(x) );
+        p = r.ptr;
+        while ( p < end && std::isspace(*p) && *p != delimiter ) p++;
+        if ( p == end ) return;
+        if ( *p++ != delimiter ) throw string("Invalid number: ") + string( r.ptr, std::find(r.ptr, end, delimiter) );
+    }
+}
+
+// Values of a .npy file, or of a text file with one per line, which is
+// mapped and parsed in parallel.
 template <class T> vector<T>
 load(const string & filename)
 {
+    MappedFile file(filename);
     vector<T> v;
-    ifstream fin(filename);
-    string line;
-    while ( getline(fin, line) ) v.push_back( T( stod(line) ) );
+    if ( NpyArray::is(file) )
+    {
+        NpyArray a( std::move(file) );
+        v.resize( a.size() );
+        if ( auto p = a.view<T>() )
+            forRanges(v.size(), [&](size_t b, size_t e) { std::copy(p + b, p + e, v.begin() + b); });
+        else
+            forRanges(v.size(), [&](size_t b, size_t e) { for (auto i=b; i<e; i++) v[i] = a.get<T>(i); });
+        return v;
+    }
+    auto text = lines(file);
+    v.resize( text.size() );
+    forRanges(v.size(), [&](size_t b, size_t e)
+    {
+        vector<T> row;
+        for ( auto i=b; i<e; i++ )
+        {
+            row.clear();
+            parseLine(text[i].first, text[i].second, '\n', row);
+            if ( row.size() != 1 ) throw filename + ": line " + std::to_string(i + 1) + " holds " + std::to_string( row.size() ) + " values";
+            v[i] = row[0];
+        }
+    });
     return v;
 }
 
+// Rows of a two-dimensional .npy file, or of a delimited text file, which is
+// mapped and parsed in parallel.
 template <class T> vector<vector<T>>
 load(const string & filename, char delimiter)
 {
+    MappedFile file(filename);
     vector<vector<T>> m;
-    ifstream fin(filename);
-    string line;
-    while ( getline(fin, line) )
+    if ( NpyArray::is(file) )
     {
-        auto items = split(line, delimiter);
-        vector<T> v;
-        for ( auto & item : items ) v.push_back( stod(trim(item)) );
-        m.push_back(v);
+        NpyArray a( std::move(file) );
+        if ( a.shape().size() != 2 ) throw filename + " is not two-dimensional";
+        size_t cols = a.shape()[1];
+        m.resize( a.shape()[0] );
+        auto p = a.view<T>();
+        forRanges(m.size(), [&](size_t b, size_t e)
+        {
+            for ( auto i=b; i<e; i++ )
+            {
+                if (p) { m[i].assign(p + i * cols, p + (i + 1) * cols); continue; }
+                m[i].resize(cols);
+                for ( size_t j=0; j<cols; j++ ) m[i][j] = a.get<T>(i * cols + j);
+            }
+        });
+        return m;
     }
+    auto text = lines(file);
+    m.resize( text.size() );
+    forRanges(m.size(), [&](size_t b, size_t e)
+    {
+        for ( auto i=b; i<e; i++ ) parseLine(text[i].first, text[i].second, delimiter, m[i]);
+    });
     return m;
 }
 
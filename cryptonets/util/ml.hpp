@@ -164,7 +164,8 @@ predict(vector<vector<vector<vector<T>>>> & x, const vector<size_t> & y,
 
     t = Timer();
 #ifdef USING_CRT
-    auto h8p = decrypt(h8);
+    // decrypted straight into the [sample][class] matrix
+    auto h8_reshaped2 = decryptUnpack(h8);
 #else
     auto h8p = decrypt<T,U>(h8);
 #endif
@@ -172,6 +173,7 @@ predict(vector<vector<vector<vector<T>>>> & x, const vector<size_t> & y,
     CLEAR(h8);
     show_reset_timers();
 
+#ifndef USING_CRT
     t = Timer();
 #ifdef SCHEME_PLAIN
     auto & h8_reshaped2 = h8p;
@@ -183,6 +185,7 @@ predict(vector<vector<vector<vector<T>>>> & x, const vector<size_t> & y,
     auto h8_reshaped2 = reshapeOrder( h8_combined, vector<size_t>{1,0} );
 #endif
     showInfo<T>("plainops", t, h8_reshaped2, "h8_reshaped2");
+#endif
 
     auto o = argmax(h8_reshaped2);
     acc = double( countEqual(o, y) ) / o.size();
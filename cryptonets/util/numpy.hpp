@@ -2,7 +2,10 @@
 
 #include <algorithm>
 #include <iterator>
+#include <type_traits>
 #include <vector>
+#include "numpy.h"
+#include "parallel.h"
 
 using std::vector;
 
@@ -17,16 +20,27 @@ size_t sizeCeilPowerOfTwo(size_t n)
     return counter;
 }
 
+// no pending relinearization for plain types; ciphertext types overload it
+template <class T> void relinearize(T &) {}
+
 template <class T>
 T add_vector(vector<T> & v)
 {
-    auto size = v.size();
-    for ( auto n = 1<<sizeCeilPowerOfTwo(size); n>1; )
+    if constexpr ( numpy::has_add_many<T>::value )
     {
-        n >>= 1;
-        for ( size_t i=n; i<size; i++ ) v[i-n] += v[i];
-        size = n;
+        if ( v.size() > 1 ) v[0] = numpy::add_many(v);
+    }
+    else
+    {
+        auto size = v.size();
+        for ( auto n = 1<<sizeCeilPowerOfTwo(size); n>1; )
+        {
+            n >>= 1;
+            for ( size_t i=n; i<size; i++ ) v[i-n] += v[i];
+            size = n;
+        }
     }
+    relinearize(v[0]); // found by ADL for ciphertext types
     return v[0];
 }
 
@@ -12,8 +12,14 @@ decrypt(const CRT<T> & a)
 template <class T> vector<vector<T>>
 decrypt(const vector<CRT<T>> & a)
 {
-    vector<vector<T>> r;
-    for ( auto & e : a ) r.push_back( decrypt(e) );
+    vector<const CRT<T> *> numbers;
+    for ( auto & e : a ) numbers.push_back(&e);
+    auto n = CRT<T>::slots();
+    vector<T> flat( a.size() * n );
+    CRT<T>::decode(numbers, flat.data());
+
+    vector<vector<T>> r( a.size() );
+    for ( size_t i=0; i<a.size(); i++ ) r[i].assign( flat.begin() + i*n, flat.begin() + (i+1)*n );
     return r;
 }
 
@@ -40,3 +46,23 @@ decrypt(const vector<vector<vector<vector<CRT<T>>>>> & a)
     for ( auto & e : a ) r.push_back( decrypt(e) );
     return r;
 }
+
+// Decrypts a [chunk][column] matrix of packed numbers into the matrix of
+// their slots, [chunk * slots + slot][column], in one batch
+template <class T> vector<vector<T>>
+decryptUnpack(const vector<vector<CRT<T>>> & a)
+{
+    if ( a.empty() ) return {};
+    auto cols = a[0].size(), n = CRT<T>::slots();
+    vector<const CRT<T> *> numbers;
+    for ( auto & v : a )
+        for ( auto & e : v ) numbers.push_back(&e);
+    vector<T> flat( numbers.size() * n );
+    CRT<T>::decode(numbers, flat.data());
+
+    vector<vector<T>> r( a.size() * n, vector<T>(cols) );
+    for ( size_t k=0; k<a.size(); k++ )
+        for ( size_t c=0; c<cols; c++ )
+            for ( size_t s=0; s<n; s++ ) r[k*n + s][c] = flat[(k*cols + c)*n + s];
+    return r;
+}
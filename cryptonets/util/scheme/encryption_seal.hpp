@@ -1,5 +1,6 @@
 #pragma once
 
+#include <iterator>
 #include <vector>
 #include "crt.hpp"
 
@@ -79,47 +80,59 @@ crtEncrypt(const vector<vector<vector<vector<T>>>> & a)
     return r;
 }
 
+// The pack overloads gather every innermost vector and encrypt them in one
+// batch, spread over the threads.
 template <class T> vector<CRT<T>>
 crtEncryptPack(const vector<T> & a)
 {
-    vector<T> v;
-    v.assign(a.begin(), a.end());
-    auto nElems = a.size();
-    auto slots = CRT<T>::slots();
-    // auto mod = nElems % slots;
-    auto mod = (slots - nElems) % slots; // changed from 'mod = nElems % slots;'
-    v.resize(v.size()+mod, 0);
-    vector<CRT<T>> r;
-    for ( size_t i=0; i<v.size(); i+=slots )
-    {
-        vector<T> tmp;
-        for ( size_t j=0; j<slots; j++ )
-            tmp.push_back(v[i+j]);
-        r.push_back( CRT<T>(tmp, true) );
-    }
-    return r;
+    return std::move( CRT<T>::encryptPacked({&a})[0] );
 }
 
 template <class T> vector<vector<CRT<T>>>
 crtEncryptPack(const vector<vector<T>> & a)
 {
-    vector<vector<CRT<T>>> r;
-    for ( auto & e : a ) r.push_back( crtEncryptPack(e) );
-    return r;
+    vector<const vector<T> *> leaves;
+    for ( auto & e : a ) leaves.push_back(&e);
+    return CRT<T>::encryptPacked(leaves);
 }
 
 template <class T> vector<vector<vector<CRT<T>>>>
 crtEncryptPack(const vector<vector<vector<T>>> & a)
 {
-    vector<vector<vector<CRT<T>>>> r;
-    for ( auto & e : a ) r.push_back( crtEncryptPack(e) );
+    vector<const vector<T> *> leaves;
+    for ( auto & m : a )
+        for ( auto & e : m ) leaves.push_back(&e);
+    auto packed = CRT<T>::encryptPacked(leaves);
+
+    vector<vector<vector<CRT<T>>>> r( a.size() );
+    auto it = std::make_move_iterator( packed.begin() );
+    for ( size_t i=0; i<a.size(); i++ )
+    {
+        r[i].assign( it, it + a[i].size() );
+        it += a[i].size();
+    }
     return r;
 }
 
 template <class T> vector<vector<vector<vector<CRT<T>>>>>
 crtEncryptPack(const vector<vector<vector<vector<T>>>> & a)
 {
-    vector<vector<vector<vector<CRT<T>>>>> r;
-    for ( auto & e : a ) r.push_back( crtEncryptPack(e) );
+    vector<const vector<T> *> leaves;
+    for ( auto & n : a )
+        for ( auto & m : n )
+            for ( auto & e : m ) leaves.push_back(&e);
+    auto packed = CRT<T>::encryptPacked(leaves);
+
+    vector<vector<vector<vector<CRT<T>>>>> r( a.size() );
+    auto it = std::make_move_iterator( packed.begin() );
+    for ( size_t i=0; i<a.size(); i++ )
+    {
+        r[i].resize( a[i].size() );
+        for ( size_t j=0; j<a[i].size(); j++ )
+        {
+            r[i][j].assign( it, it + a[i][j].size() );
+            it += a[i][j].size();
+        }
+    }
     return r;
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "parallel.h"
 #include "seal_bfv.h"
 
 #if (TEMPLATE == 1)
@@ -20,6 +21,12 @@
     #include "cache_notempl.h"
 #endif
 
+#if (THREADS != 1 && TEMPLATE >= 1 && TEMPLATE <= 7)
+    #error "TEMPLATE=1 to TEMPLATE=7 are single-threaded, use THREADS=1"
+#elif (THREADS != 1 && TEMPLATE == 8 && CONCURRENT != 1)
+    #error "THREADS different from 1 requires CONCURRENT=1"
+#endif
+
 namespace crypto
 {
 
@@ -3,15 +3,12 @@
 #include <algorithm>
 #include <string>
 #include <vector>
+#include "parallel.h"
 
 using std::max;
 using std::string;
 using std::vector;
 
-#ifndef CACHE_RESIZE
-    #define CACHE_RESIZE -1
-#endif
-
 template <class T, class U> vector<vector<vector<T>>>
 pad(const vector<vector<vector<T>>> & input, const vector<vector<vector<vector<U>>>> & filters, const vector<size_t> & strides)
 {
@@ -74,10 +71,19 @@ conv2d(
         nRowsOut, vector<vector<T>>(
             nColsOut, vector<T>( nChannelsOut )
     ));
-    size_t rowOffset = 0;
-    // for each row of the output
-    for ( size_t io=0; io<nRowsOut; io++ )
+    // each worker convolves a band of consecutive output rows; an input row
+    // is released as soon as its band has passed it, unless it still lies in
+    // the filter window of the last row of the previous band
+    size_t nBands = std::min( nRowsOut, parallel::threads() );
+    parallel::run( nBands, [&](size_t band)
+    {
+    size_t firstRow = band * nRowsOut / nBands;
+    size_t lastRow = (band + 1) * nRowsOut / nBands;
+    size_t firstFree = band ? (firstRow-1) * rowStride + nRowsFilter : 0;
+    // for each row of the output's band
+    for ( size_t io=firstRow; io<lastRow; io++ )
     {
+        size_t rowOffset = io * rowStride;
         size_t colOffset = 0;
         // for each item of the output's row
         for ( size_t jo=0; jo<nColsOut; jo++ )
@@ -103,15 +109,17 @@ conv2d(
             }
             colOffset += colStride;
         }
-        for (int k=rowOffset; k<rowOffset+rowStride; k++)
+        for (size_t k=max(rowOffset, firstFree); k<rowOffset+rowStride; k++)
         {
             input[k].clear();
 #if (TEMPLATE==8)
-            T::resizeCache(CACHE_RESIZE);
+            T::trimCache();
 #endif
         }
-        rowOffset += rowStride;
     }
+    });
+    // rows shared by two bands are released once every band is done
+    for (size_t k=0; k<nRowsOut*rowStride; k++) input[k].clear();
     return output;
 }
 
@@ -9,6 +9,7 @@
 #include "math.h"
 #include "matrix.h"
 #include "numpy.h"
+#include "parallel.h"
 
 using namespace crypto;
 using namespace io; // debug
@@ -50,6 +51,7 @@ try
     int maxValue = 1 << ( flog2(t) >> 1 ); // half bits of t, for simplicity
 #endif
     cout << "\nMaximum value: " << maxValue << '\n';
+    cout << "Threads: " << parallel::threads() << '\n';
 
     auto a = generateMatrix(row, mid, maxValue);
     cout << "Matrix A: "; print(shape(a));// printSummary(a);
@@ -64,9 +66,13 @@ try
     cout << "ok\n";
     cout << "Matrix X = encrypt(A): "; print(shape(x));// printSummary(x);
 
+    cout << "Preparing weights .. " << flush;
+    auto w = prepare(b);
+    cout << "ok\n";
+
     cout << "Multiplying matrices .. " << flush;
     high_resolution_clock::time_point timer = high_resolution_clock::now();
-    auto y = matrixMultiplication(x, b);
+    auto y = matrixMultiplication(x, w);
     microseconds elapsed = duration_cast<microseconds>(high_resolution_clock::now() - timer);
     cout << "ok\n";
     cout << "Matrix Y = X x B: "; print(shape(y));// printSummary(y);
@@ -88,12 +94,19 @@ try
 
     std::cout << "# native copy = " << nativeCopyCounter << '\n';
 #if (TEMPLATE==8)
-    std::cout << "# ciphertexts = " << smart::Wrapper::getManager().getCounter() << '\n';
-    std::cout << "cache entries = " << smart::Wrapper::getCache().size()         << '\n';
-    std::cout << " # cache hits = " << smart::Wrapper::getCache().getHits()      << '\n';
-    std::cout << " # cache miss = " << smart::Wrapper::getCache().getMisses()    << '\n';
-    std::cout << " # cache reqs = " << smart::Wrapper::getCache().getRequests()  << '\n';
-    // std::cout << " # cache gets = " << smart::Wrapper::getCache().getCounter() << '\n';
+    for (int c = 1; c <= smart::Wrapper::nContexts(); c++)
+    {
+        auto & cache = smart::Wrapper::getCache(c);
+        std::cout << "key context " << c << ":\n";
+        std::cout << "# ciphertexts = " << smart::Wrapper::getManager(c).getCounter() << '\n';
+        std::cout << "cache entries = " << cache.size()         << '\n';
+        std::cout << "  cache bytes = " << cache.bytes()        << '\n';
+        std::cout << " # cache hits = " << cache.getHits()      << '\n';
+        std::cout << " # spill hits = " << cache.getSpillHits() << '\n';
+        std::cout << " # cache miss = " << cache.getMisses()    << '\n';
+        std::cout << " # cache reqs = " << cache.getRequests()  << '\n';
+    }
+    std::cout << "native allocs = " << smart::arena::stats().allocations  << '\n';
 #endif
 
     cout << "Counters: "; print( counters() );
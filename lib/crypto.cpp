@@ -3,6 +3,9 @@
 #include "matrix.h"
 #include "numpy.h"
 
+#include <algorithm>
+#include <iterator>
+
 #define IS_TEMPLATE(templ) (templ >= 1)
 
 using namespace matrix;
@@ -27,23 +30,41 @@ vector<int> decrypt(const Ciphertext & ct)
     return vector<int>(x);
 }
 
+// Decrypts count ciphertexts side by side, the k-th being ct(k)
+template <class F>
+static vector<vector<int>> decryptAll(size_t count, const F & ct)
+{
+    vector<vector<int>> vpt(count);
+    parallel::run( count, [&](size_t k) { vpt[k] = decrypt( ct(k) ); } );
+    return vpt;
+}
+
 vector<int> decrypt(const vector<Ciphertext> & vct)
 {
+    auto pts = decryptAll( vct.size(), [&](size_t k) -> const Ciphertext & { return vct[k]; } );
     vector<int> vpt;
-    for (auto & ct : vct)
-    {
-        auto pt = decrypt(ct);
-        vpt.insert(vpt.end(), pt.begin(), pt.end());
-    }
+    for (auto & pt : pts) vpt.insert(vpt.end(), pt.begin(), pt.end());
     return vpt;
 }
 
+// slot s of ciphertext [i][j] goes to vpt[i * slots + s][j]
 vector<vector<int>> decrypt(const vector<vector<Ciphertext>> & vx)
 {
-    auto vct = transpose(vx);
-    vector<vector<int>> vpt;
-    for (auto & e : vct) vpt.push_back( decrypt(e) );
-    return transpose(vpt);
+    if ( vx.empty() || vx[0].empty() ) return {};
+    size_t rows = vx.size(), cols = vx[0].size();
+    auto pts = decryptAll( rows * cols, [&](size_t k) -> const Ciphertext & { return vx[k / cols][k % cols]; } );
+
+    size_t n = pts[0].size();
+    vector<vector<int>> vpt( rows * n, vector<int>(cols) );
+    parallel::run( rows, [&](size_t i)
+    {
+        for (size_t j = 0; j < cols; j++)
+        {
+            const auto & pt = pts[i * cols + j];
+            for (size_t s = 0; s < n; s++) vpt[i * n + s][j] = pt[s];
+        }
+    });
+    return vpt;
 }
 
 vector<vector<int>> decrypt(const vector<vector<Ciphertext>> & vx, int row, int col)
@@ -64,12 +85,31 @@ vector<vector<vector<int>>> decrypt(const vector<vector<vector<Ciphertext>>> & v
     return vpt;
 }
 
+// slot s of ciphertext [i][b][c][d] goes to vpt[i * slots + s][b][c][d]
 vector<vector<vector<vector<int>>>> decrypt(const vector<vector<vector<vector<Ciphertext>>>> & vx)
 {
-    auto vt = numpy::reshapeOrder(vx, vector<size_t>{1, 2, 3, 0});
-    vector<vector<vector<vector<int>>>> vpt;
-    for (auto & e : vt) vpt.push_back( decrypt(e) );
-    return numpy::reshapeOrder(vpt, vector<size_t>{3, 0, 1, 2});
+    if ( vx.empty() || vx[0].empty() || vx[0][0].empty() || vx[0][0][0].empty() ) return {};
+    size_t rows = vx.size(), nb = vx[0].size(), nc = vx[0][0].size(), nd = vx[0][0][0].size();
+    size_t inner = nb * nc * nd;
+    auto pts = decryptAll( rows * inner, [&](size_t k) -> const Ciphertext &
+    {
+        size_t i = k / inner, r = k % inner;
+        return vx[i][r / (nc * nd)][r / nd % nc][r % nd];
+    });
+
+    size_t n = pts[0].size();
+    vector<vector<vector<vector<int>>>> vpt( rows * n,
+        vector<vector<vector<int>>>( nb, vector<vector<int>>( nc, vector<int>(nd) ) ) );
+    parallel::run( rows, [&](size_t i)
+    {
+        for (size_t r = 0; r < inner; r++)
+        {
+            const auto & pt = pts[i * inner + r];
+            size_t b = r / (nc * nd), c = r / nd % nc, d = r % nd;
+            for (size_t s = 0; s < n; s++) vpt[i * n + s][b][c][d] = pt[s];
+        }
+    });
+    return vpt;
 }
 
 Ciphertext encrypt(int m)
@@ -82,59 +122,121 @@ Ciphertext encrypt(const vector<int> & vm)
     return Ct(vm);
 }
 
+// Encrypts count ciphertexts side by side, ciphertext i holding the values
+// that pack(i, values) puts in its slots, and registers them in one go
+template <class F>
+static vector<Ciphertext> encryptAll(size_t count, const F & pack)
+{
+    vector<Ct> natives(count);
+    parallel::run( count, [&](size_t i)
+    {
+        vector<int> values;
+        pack(i, values);
+        natives[i] = Ct(values);
+    });
+#if (TEMPLATE == 8)
+    return Ciphertext::wrap( move(natives) );
+#elif IS_TEMPLATE(TEMPLATE)
+    return vector<Ciphertext>( make_move_iterator(natives.begin()), make_move_iterator(natives.end()) );
+#else
+    return natives;
+#endif
+}
+
 vector<Ciphertext> encrypt(const vector<int> & vm, int n)
 {
-    vector<Ciphertext> vx;
-    vector<int> vtmp;
-    for (auto & e : vm)
+    size_t count = (vm.size() + n - 1) / n;
+    return encryptAll( count, [&](size_t k, vector<int> & values)
     {
-        vtmp.push_back(e);
-        if ( vtmp.size() == n )
-        {
-            vx.push_back( encrypt(vtmp) );
-            vtmp.clear();
-        }
-    }
-    if ( !vtmp.empty() ) vx.push_back( encrypt(vtmp) );
-    return vx;
+        auto begin = vm.begin() + k * n;
+        values.assign( begin, begin + min<size_t>(n, vm.end() - begin) );
+    });
 }
 
+// vm[i][j] goes to slot i % n of ciphertext [i / n][j]
 vector<vector<Ciphertext>> encrypt(const vector<vector<int>> & vm, int n)
 {
-    auto vt = transpose(vm);
-    vector<vector<Ciphertext>> vx;
-    for (auto & e : vt) vx.push_back( encrypt(e, n) );
-    return transpose(vx);
+    if ( vm.empty() ) return {};
+    size_t rows = vm.size(), cols = vm[0].size(), count = (rows + n - 1) / n;
+    auto flat = encryptAll( count * cols, [&](size_t k, vector<int> & values)
+    {
+        size_t r = k / cols * n, c = k % cols;
+        values.resize( min<size_t>(n, rows - r) );
+        for (size_t i = 0; i < values.size(); i++) values[i] = vm[r + i][c];
+    });
+
+    vector<vector<Ciphertext>> vx(count);
+    auto it = make_move_iterator( flat.begin() );
+    for (auto & v1 : vx) v1.assign(it, it + cols), it += cols;
+    return vx;
 }
 
+// vm[i][b][c][d] goes to slot i % n of ciphertext [i / n][b][c][d]
 vector<vector<vector<vector<Ciphertext>>>> encrypt(
     const vector<vector<vector<vector<int>>>> & vm, int n
 )
 {
-    auto vt = numpy::reshapeOrder(vm, vector<size_t>{1, 2, 3, 0});
-    vector<vector<vector<vector<Ciphertext>>>> vx;
-    for (auto & v3 : vt)
+    if ( vm.empty() ) return {};
+    size_t na = vm.size(), nb = vm[0].size(), nc = nb ? vm[0][0].size() : 0;
+    size_t nd = nc ? vm[0][0][0].size() : 0, count = (na + n - 1) / n;
+    auto flat = encryptAll( count * nb * nc * nd, [&](size_t k, vector<int> & values)
     {
-        vector<vector<vector<Ciphertext>>> tmp3;
+        size_t d = k % nd, c = k / nd % nc, b = k / (nd * nc) % nb, a = k / (nd * nc * nb) * n;
+        values.resize( min<size_t>(n, na - a) );
+        for (size_t i = 0; i < values.size(); i++) values[i] = vm[a + i][b][c][d];
+    });
+
+    vector<vector<vector<vector<Ciphertext>>>> vx( count, vector<vector<vector<Ciphertext>>>(nb, vector<vector<Ciphertext>>(nc)) );
+    auto it = make_move_iterator( flat.begin() );
+    for (auto & v3 : vx)
         for (auto & v2 : v3)
-        {
-            vector<vector<Ciphertext>> tmp2;
-            for (auto & v1 : v2) tmp2.push_back( encrypt(v1, n) );
-            tmp3.push_back(tmp2);
-        }
-        vx.push_back(tmp3);
-    }
-    return numpy::reshapeOrder(vx, vector<size_t>{3, 0, 1, 2});
+            for (auto & v1 : v2) v1.assign(it, it + nd), it += nd;
+    return vx;
 }
 
 void init(int n, int t, int depth)
 {
-    SealBFVKeys keys(n, t);
+    auto keys = SealBFVKeys::openKeys(n, t);
     SealBFVPlaintext::defaultKeys(keys);
     SealBFVCiphertext::defaultKeys(keys);
     init_template(t, depth);
 }
 
+// Weights are fixed across inferences, so their encoding (and NTT, when not
+// a scalar) is done once here instead of at every multiplication
+Weight prepare(int w)
+{
+#if (TEMPLATE == 0)
+    return SealBFVPlaintext(w).prepare();
+#else
+    return w;
+#endif
+}
+
+vector<vector<Weight>> prepare(const vector<vector<int>> & vw)
+{
+    vector<vector<Weight>> vp;
+    for (auto & v1 : vw)
+    {
+        vector<Weight> tmp1;
+        for (auto & e : v1) tmp1.push_back( prepare(e) );
+        vp.push_back(tmp1);
+    }
+    return vp;
+}
+
+vector<vector<vector<vector<Weight>>>> prepare(const vector<vector<vector<vector<int>>>> & vw)
+{
+    vector<vector<vector<vector<Weight>>>> vp;
+    for (auto & v3 : vw)
+    {
+        vector<vector<vector<Weight>>> tmp3;
+        for (auto & v2 : v3) tmp3.push_back( prepare(v2) );
+        vp.push_back(tmp3);
+    }
+    return vp;
+}
+
 void init_template(int t, int depth)
 {
 #if (TEMPLATE >= 1 && TEMPLATE <= 6)
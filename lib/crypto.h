@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <vector>
+#include "parallel.h"
 #include "seal_bfv.h"
 
 #if (TEMPLATE == 1)
@@ -22,6 +23,12 @@
     #include "cache_notempl.h"
 #endif
 
+#if (THREADS != 1 && TEMPLATE >= 1 && TEMPLATE <= 7)
+    #error "TEMPLATE=1 to TEMPLATE=7 are single-threaded, use THREADS=1"
+#elif (THREADS != 1 && TEMPLATE == 8 && CONCURRENT != 1)
+    #error "THREADS different from 1 requires CONCURRENT=1"
+#endif
+
 namespace crypto
 {
 
@@ -47,6 +54,14 @@ using Ct = seal_wrapper::SealBFVCiphertext;
     using Ciphertext = Ct;
 #endif
 
+// plaintext operand of encrypted layers: smart types take the raw scalar,
+// which also keys their operation cache
+#if (TEMPLATE == 0)
+    using Weight = seal_wrapper::SealBFVPlaintext;
+#else
+    using Weight = int;
+#endif
+
 std::vector<int> counters();
 std::vector<int> decrypt(const Ciphertext &);
 std::vector<int> decrypt(const std::vector<Ciphertext> &);
@@ -60,6 +75,9 @@ std::vector<Ciphertext> encrypt(const std::vector<int> &, int n);
 std::vector<std::vector<Ciphertext>> encrypt(const std::vector<std::vector<int>> &, int n);
 std::vector<std::vector<std::vector<std::vector<Ciphertext>>>> encrypt(const std::vector<std::vector<std::vector<std::vector<int>>>> &, int n);
 void init(int n, int t, int depth=3);
+Weight prepare(int);
+std::vector<std::vector<Weight>> prepare(const std::vector<std::vector<int>> &);
+std::vector<std::vector<std::vector<std::vector<Weight>>>> prepare(const std::vector<std::vector<std::vector<std::vector<int>>>> &);
 void init_template(int t, int depth);
 
 } // crypto
@@ -1,12 +1,14 @@
 #pragma once
 
+#include <algorithm>
 #include "numpy.h"
+#include "parallel.h"
 
 namespace matrix
 {
 
 #if (TEMPLATE == 8)
-template <class T> void resize() { T::resizeCache(CACHE_RESIZE); }
+template <class T> void resize() { T::trimCache(); }
 template <> inline void resize<int>() {}
 template <> inline void resize<unsigned>() {}
 template <> inline void resize<int64_t>() {}
@@ -41,10 +43,16 @@ conv2d(
             nRowsOut, std::vector<T>( nColsOut )
     ));
 
-    size_t rowOffset = 0;
-    // for each row of the output
-    for ( size_t io=0; io<nRowsOut; io++ )
+    // each worker convolves a band of consecutive output rows, so the input
+    // rows it reads (and the OOM entries built from them) overlap only at
+    // the band borders
+    size_t nBands = std::min( nRowsOut, parallel::threads() );
+    parallel::run( nBands, [&](size_t band)
     {
+    // for each row of the output's band
+    for ( size_t io=band*nRowsOut/nBands; io<(band+1)*nRowsOut/nBands; io++ )
+    {
+        size_t rowOffset = io * rowStride;
         size_t colOffset = 0;
         // for each item of the output's row
         for ( size_t jo=0; jo<nColsOut; jo++ )
@@ -73,8 +81,8 @@ conv2d(
 #if (TEMPLATE==8)
         resize<T>();
 #endif
-        rowOffset += rowStride;
     }
+    });
     return output;
 }
 
@@ -101,16 +109,27 @@ matrixMultiplication(const std::vector<std::vector<T>> & a, const std::vector<st
 
     if ( m != b.size() ) throw "Matrices do not have compatible dimensions";
 
+    // the output is split in tiles of one row and several columns; all tiles
+    // of row i are queued on the same worker, so the products of a[i][k]
+    // (and their OOM entries) are produced and reused there, while idle
+    // workers steal tiles to balance the load
+    size_t nTasks = 8 * parallel::threads();
+    size_t tile = std::min( p, std::max( size_t(1), (n * p + nTasks - 1) / nTasks ) );
+    size_t nTiles = (p + tile - 1) / tile;
+
     std::vector<std::vector<T>> c(n, std::vector<T>(p));
-    for (int i=0; i<n; i++)
+    parallel::run( n * nTiles, [&](size_t t)
     {
-        for (int j=0; j<p; j++)
+        auto i = t / nTiles;
+        auto begin = (t % nTiles) * tile;
+        auto end = std::min(begin + tile, p);
+        for (size_t j=begin; j<end; j++)
         {
             std::vector<T> partial;
             for (int k=0; k<m; k++) partial.push_back( a[i][k] * b[k][j] );
             c[i][j] = numpy::sum_inplace(partial);
         }
-    }
+    }, [&](size_t t) { return t / nTiles; } );
     return c;
 }
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <type_traits>
 #include <vector>
 
 using std::size_t;
@@ -7,6 +8,13 @@ using std::size_t;
 namespace numpy
 {
 
+// types with a fused T::add_many(const std::vector<const T *> &) are summed
+// with it instead of a tree of pairwise +=
+template <class T, class = void> struct has_add_many : std::false_type {};
+template <class T> struct has_add_many<T, std::void_t<
+    decltype( T::add_many( std::declval<const std::vector<const T *> &>() ) )
+>> : std::true_type {};
+
 template <class T> bool
 operator ==(const std::vector<T> &, const std::vector<T> &);
 
@@ -16,6 +24,8 @@ add(const std::vector<std::vector<T>> &, const std::vector<U> &);
 template <class T, class U> std::vector<std::vector<std::vector<std::vector<T>>>>
 add(const std::vector<std::vector<std::vector<std::vector<T>>>> &, const std::vector<U> &);
 
+template <class T> T add_many(const std::vector<T> &);
+
 template <class T> std::vector<size_t> argmax(const std::vector<std::vector<T>> &);
 
 template <class T> std::vector<std::vector<T>>
@@ -37,6 +47,8 @@ template <class T> T mean(const std::vector<std::vector<std::vector<std::vector<
 
 template <class T> T product_inplace(std::vector<T> &);
 
+template <class T> void relinearize(T &);
+
 template <class T> std::vector<std::vector<T>>
 reshape2d(const std::vector<std::vector<std::vector<std::vector<T>>>> &, const std::vector<size_t> & dimensions);
 
@@ -2,12 +2,45 @@
 
 #include <algorithm>
 #include <iterator>
+#include <mutex>
 #include <vector>
 #include "math.h"
+#include "parallel.h"
 
 namespace numpy
 {
 
+// operands per chunk below which a fused sum is not split across threads
+const size_t ADD_MANY_CHUNK = 64;
+
+template <class T>
+T add_many(const std::vector<T> & v)
+{
+    std::vector<const T *> operands;
+    for (auto & e : v) operands.push_back(&e);
+    size_t nChunks = std::min( parallel::threads(), v.size() / ADD_MANY_CHUNK );
+    if ( nChunks < 2 ) return T::add_many(operands);
+
+    // the order of the partial sums does not matter, so each chunk appends
+    // its own instead of overwriting a copy of an operand
+    std::vector<T> partial;
+    partial.reserve(nChunks);
+    std::mutex mutex;
+    parallel::run( nChunks, [&](size_t c)
+    {
+        std::vector<const T *> chunk(
+            operands.begin() + c * v.size() / nChunks,
+            operands.begin() + (c + 1) * v.size() / nChunks
+        );
+        auto sum = T::add_many(chunk);
+        std::lock_guard<std::mutex> lock(mutex);
+        partial.emplace_back( std::move(sum) );
+    });
+    operands.clear();
+    for (auto & e : partial) operands.push_back(&e);
+    return T::add_many(operands);
+}
+
 template <class T> bool
 operator ==(const std::vector<T> & a, const std::vector<T> & b)
 {
@@ -155,6 +188,9 @@ T product_inplace(std::vector<T> & v)
     return v[0];
 }
 
+// no pending relinearization for plain types; ciphertext types overload it
+template <class T> void relinearize(T &) {}
+
 template <class T> std::vector<std::vector<T>>
 reshape2d(const std::vector<std::vector<std::vector<std::vector<T>>>> & a, const std::vector<size_t> & dimensions)
 {
@@ -471,15 +507,23 @@ T sum(const std::vector<T> & v)
 template <class T>
 T sum_inplace(std::vector<T> & v)
 {
-    auto size = v.size();
-    for ( auto n = 1 << math::msb(size); n > 1; )
+    if constexpr ( has_add_many<T>::value )
     {
-        n >>= 1;
-        for ( size_t i = n; i < size; i++ ) v[i - n] += v[i];
-        size = n;
+        if ( v.size() > 1 ) v[0] = add_many(v);
+    }
+    else
+    {
+        auto size = v.size();
+        for ( auto n = 1 << math::msb(size); n > 1; )
+        {
+            n >>= 1;
+            for ( size_t i = n; i < size; i++ ) v[i - n] += v[i];
+            size = n;
+        }
     }
     v.resize(1);
-    return v[0];
+    relinearize(v[0]); // found by ADL for ciphertext types
+    return std::move(v[0]);
 }
 
 } // numpy
@@ -0,0 +1,126 @@
+#include "parallel.h"
+
+using namespace std;
+
+namespace parallel
+{
+
+static thread_local int worker_index = -1;
+static unique_ptr<ThreadPool> default_pool;
+static size_t n_threads = 1;
+static bool configured = false;
+static once_flag default_init;
+
+ThreadPool::ThreadPool(size_t nWorkers)
+{
+    for ( size_t i=0; i<nWorkers; i++ ) queues.push_back( make_unique<Queue>() );
+    for ( size_t i=0; i<nWorkers; i++ ) workers.emplace_back( [this, i]() { work(i); } );
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wake.notify_all();
+    for (auto & w : workers) w.join();
+}
+
+// execute one pending task on the calling thread, if there is any
+bool ThreadPool::help()
+{
+    Task task;
+    auto self = worker_index;
+    if ( !( self >= 0 && pop(self, task) ) && !steal(self < 0 ? 0 : self, task) ) return false;
+    task();
+    return true;
+}
+
+bool ThreadPool::pop(size_t self, Task & task)
+{
+    auto & q = *queues[self];
+    lock_guard<std::mutex> lock(q.mutex);
+    if ( q.tasks.empty() ) return false;
+    task = move( q.tasks.back() );
+    q.tasks.pop_back();
+    queued--;
+    return true;
+}
+
+bool ThreadPool::steal(size_t self, Task & task)
+{
+    auto n = queues.size();
+    for ( size_t i=1; i<=n; i++ )
+    {
+        auto & q = *queues[ (self + i) % n ];
+        lock_guard<std::mutex> lock(q.mutex);
+        if ( q.tasks.empty() ) continue;
+        task = move( q.tasks.front() );
+        q.tasks.pop_front();
+        queued--;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::submit(size_t worker, Task task)
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        queued++;
+    }
+    auto & q = *queues[ worker % queues.size() ];
+    {
+        lock_guard<std::mutex> lock(q.mutex);
+        q.tasks.push_back( move(task) );
+    }
+    wake.notify_one();
+}
+
+void ThreadPool::work(size_t self)
+{
+    worker_index = int(self);
+    Task task;
+    while (true)
+    {
+        if ( pop(self, task) || steal(self, task) )
+        {
+            task();
+            task = nullptr;
+            continue;
+        }
+        unique_lock<std::mutex> lock(mutex);
+        wake.wait( lock, [this]() { return stop || queued > 0; } );
+        if (stop) return;
+    }
+}
+
+int ThreadPool::workerIndex()
+{
+    return worker_index;
+}
+
+// the calling thread also works while waiting, so a pool of n threads
+// keeps n-1 workers
+void setThreads(size_t n)
+{
+    if (!n) n = max( 1u, thread::hardware_concurrency() );
+    n_threads = n;
+    configured = true;
+    default_pool = n > 1 ? make_unique<ThreadPool>(n - 1) : nullptr;
+}
+
+size_t threads()
+{
+    pool();
+    return n_threads;
+}
+
+ThreadPool * pool()
+{
+    call_once( default_init, []() { if (!configured) setThreads(); } );
+    return default_pool.get();
+}
+
+} // parallel
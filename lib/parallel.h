@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef THREADS
+    #define THREADS 1
+#endif
+
+namespace parallel
+{
+
+using Task = std::function<void()>;
+
+// Work-stealing thread pool: every worker owns a deque, pops its own tasks
+// from the back and steals from the front of the other deques when idle.
+// Threads waiting for a batch of tasks help executing them, so nested
+// parallel regions do not deadlock.
+class ThreadPool
+{
+    private:
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::atomic<size_t> queued{0};
+        bool stop = false;
+
+        bool pop(size_t self, Task &);
+        bool steal(size_t self, Task &);
+        void work(size_t self);
+
+    public:
+        explicit ThreadPool(size_t nWorkers);
+        ~ThreadPool();
+
+        bool help();
+        size_t size() const { return workers.size(); }
+        void submit(size_t worker, Task);
+
+        static int workerIndex();
+};
+
+size_t threads();
+void setThreads(size_t n=THREADS);
+ThreadPool * pool();
+
+template <class F> void run(size_t nTasks, const F & task);
+template <class F, class G> void run(size_t nTasks, const F & task, const G & owner);
+
+} // parallel
+
+#include "parallel.hpp"
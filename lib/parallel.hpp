@@ -0,0 +1,46 @@
+#pragma once
+
+#include <exception>
+
+namespace parallel
+{
+
+template <class F> void run(size_t nTasks, const F & task)
+{
+    run(nTasks, task, [](size_t t) { return t; });
+}
+
+// Run task(0) .. task(nTasks-1) and return when all of them finished.
+// owner(t) selects the worker whose deque receives task t; other workers
+// only get it by stealing. Exceptions thrown by a task are rethrown here.
+template <class F, class G> void run(size_t nTasks, const F & task, const G & owner)
+{
+    auto p = pool();
+    if ( !p || nTasks < 2 )
+    {
+        for ( size_t t=0; t<nTasks; t++ ) task(t);
+        return;
+    }
+
+    std::atomic<size_t> remaining(nTasks);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    for ( size_t t=0; t<nTasks; t++ )
+    {
+        p->submit( owner(t), [&, t]()
+        {
+            try { task(t); }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) error = std::current_exception();
+            }
+            remaining--;
+        });
+    }
+    while (remaining)
+        if ( !p->help() ) std::this_thread::yield();
+    if (error) std::rethrow_exception(error);
+}
+
+} // parallel
@@ -7,17 +7,18 @@ using namespace io;
 using namespace seal;
 using namespace std;
 
-int nativeCopyCounter = 0;
+atomic<int> nativeCopyCounter{0};
 
 namespace seal_wrapper
 {
 
-const int N_COUNTERS = 10;
-enum Operation { CT_ADD, CT_MUL, CT_SUB, PT_ADD, PT_MUL, PT_SUB, NEG, SQ, ROT_COL, ROT_ROW };
+const int N_COUNTERS = 11;
+enum Operation { CT_ADD, CT_MUL, CT_SUB, PT_ADD, PT_MUL, PT_SUB, NEG, SQ, ROT_COL, ROT_ROW, RELIN };
 
-vector<int> SealBFVCiphertext::counters = vector<int>(N_COUNTERS, 0);
+vector<atomic<int>> SealBFVCiphertext::counters(N_COUNTERS);
 shared_ptr<SealBFVKeys> SealBFVCiphertext::default_keys;
-int SealBFVCiphertext::id_counter = 0;
+atomic<int> SealBFVCiphertext::id_counter{0};
+thread_local bool SealBFVCiphertext::counting = true;
 PrintingMode SealBFVCiphertext::printing_mode = PrintingMode::DEFAULT;
 
 SealBFVCiphertext::SealBFVCiphertext()
@@ -49,13 +50,17 @@ SealBFVCiphertext::SealBFVCiphertext(const SealBFVCiphertext & ct)
     this->keys = ct.keys;
     this->ct = ct.ct;
     this->id = ct.id;
-    nativeCopyCounter++;
+    if (counting) nativeCopyCounter++;
 }
 
+SealBFVCiphertext::SealBFVCiphertext(SealBFVCiphertext && ct) noexcept
+    : ct( std::move(ct.ct) ), id(ct.id), keys( std::move(ct.keys) )
+{}
+
 SealBFVCiphertext::SealBFVCiphertext(int s, const SealBFVKeys & keys)
     : SealBFVCiphertext()
 {
-    this->keys = make_shared<SealBFVKeys>(keys);
+    this->keys = SealBFVKeys::share(keys);
     ct = this->keys->encrypt(s);
 }
 
@@ -70,7 +75,7 @@ SealBFVCiphertext::SealBFVCiphertext(int s, const std::shared_ptr<SealBFVKeys> &
 SealBFVCiphertext::SealBFVCiphertext(uint64_t s, const SealBFVKeys & keys)
     : SealBFVCiphertext()
 {
-    this->keys = make_shared<SealBFVKeys>(keys);
+    this->keys = SealBFVKeys::share(keys);
     ct = this->keys->encrypt(s);
 }
 
@@ -85,7 +90,7 @@ SealBFVCiphertext::SealBFVCiphertext(uint64_t s, const std::shared_ptr<SealBFVKe
 SealBFVCiphertext::SealBFVCiphertext(const std::vector<int> & v, const SealBFVKeys & keys)
     : SealBFVCiphertext()
 {
-    this->keys = make_shared<SealBFVKeys>(keys);
+    this->keys = SealBFVKeys::share(keys);
     ct = this->keys->encrypt(v);
 }
 
@@ -100,7 +105,7 @@ SealBFVCiphertext::SealBFVCiphertext(const std::vector<int> & v, const std::shar
 SealBFVCiphertext::SealBFVCiphertext(const std::vector<uint64_t> & v, const SealBFVKeys & keys)
     : SealBFVCiphertext()
 {
-    this->keys = make_shared<SealBFVKeys>(keys);
+    this->keys = SealBFVKeys::share(keys);
     ct = this->keys->encrypt(v);
 }
 
@@ -148,11 +153,28 @@ SealBFVCiphertext::operator string() const
     throw "Unrecognized printing mode (in SealBFVCiphertext)";
 }
 
+SealBFVCiphertext & SealBFVCiphertext::operator =(const SealBFVCiphertext & ct)
+{
+    this->keys = ct.keys;
+    this->ct = ct.ct;
+    this->id = ct.id;
+    if (counting) nativeCopyCounter++;
+    return *this;
+}
+
+SealBFVCiphertext & SealBFVCiphertext::operator =(SealBFVCiphertext && ct) noexcept
+{
+    this->keys = std::move(ct.keys);
+    this->ct = std::move(ct.ct);
+    this->id = ct.id;
+    return *this;
+}
+
 // compound assignment operators
 SealBFVCiphertext & SealBFVCiphertext::operator~()
 {
     keys->negate_inplace(ct);
-    counters[NEG]++;
+    count(NEG);
     newId();
     return *this;
 }
@@ -190,7 +212,7 @@ SealBFVCiphertext SealBFVCiphertext::operator--(int)
 SealBFVCiphertext & SealBFVCiphertext::operator +=(const SealBFVCiphertext & a)
 {
     keys->add_inplace(ct, a.ct);
-    counters[CT_ADD]++;
+    count(CT_ADD);
     newId();
     return *this;
 }
@@ -199,15 +221,19 @@ SealBFVCiphertext & SealBFVCiphertext::operator *=(const SealBFVCiphertext & a)
 {
     if (id == a.id)
     {
+        relinearize();
         keys->square_inplace(ct);
-        counters[SQ]++;
+        count(SQ);
     }
     else
     {
-        keys->mul_inplace(ct, a.ct);
-        counters[CT_MUL]++;
+        Ciphertext tmp;
+        const auto & b = a.linear(tmp);
+        relinearize();
+        keys->mul_inplace(ct, b);
+        count(CT_MUL);
     }
-    keys->relinearize_inplace(ct);
+    relinearizeProduct(ct);
     newId();
     return *this;
 }
@@ -215,7 +241,7 @@ SealBFVCiphertext & SealBFVCiphertext::operator *=(const SealBFVCiphertext & a)
 SealBFVCiphertext & SealBFVCiphertext::operator -=(const SealBFVCiphertext & a)
 {
     keys->sub_inplace(ct, a.ct);
-    counters[CT_SUB]++;
+    count(CT_SUB);
     newId();
     return *this;
 }
@@ -223,7 +249,7 @@ SealBFVCiphertext & SealBFVCiphertext::operator -=(const SealBFVCiphertext & a)
 SealBFVCiphertext & SealBFVCiphertext::operator +=(const SealBFVPlaintext & a)
 {
     keys->add_inplace(ct, a.pt);
-    counters[PT_ADD]++;
+    count(PT_ADD);
     newId();
     return *this;
 }
@@ -231,7 +257,7 @@ SealBFVCiphertext & SealBFVCiphertext::operator +=(const SealBFVPlaintext & a)
 SealBFVCiphertext & SealBFVCiphertext::operator *=(const SealBFVPlaintext & a)
 {
     keys->mul_inplace(ct, a.pt);
-    counters[PT_MUL]++;
+    count(PT_MUL);
     newId();
     return *this;
 }
@@ -239,7 +265,7 @@ SealBFVCiphertext & SealBFVCiphertext::operator *=(const SealBFVPlaintext & a)
 SealBFVCiphertext & SealBFVCiphertext::operator -=(const SealBFVPlaintext & a)
 {
     keys->sub_inplace(ct, a.pt);
-    counters[PT_SUB]++;
+    count(PT_SUB);
     newId();
     return *this;
 }
@@ -247,7 +273,7 @@ SealBFVCiphertext & SealBFVCiphertext::operator -=(const SealBFVPlaintext & a)
 SealBFVCiphertext & SealBFVCiphertext::operator +=(int a)
 {
     keys->add_inplace(ct, a);
-    counters[PT_ADD]++;
+    count(PT_ADD);
     newId();
     return *this;
 }
@@ -255,7 +281,7 @@ SealBFVCiphertext & SealBFVCiphertext::operator +=(int a)
 SealBFVCiphertext & SealBFVCiphertext::operator *=(int a)
 {
     keys->mul_inplace(ct, a);
-    counters[PT_MUL]++;
+    count(PT_MUL);
     newId();
     return *this;
 }
@@ -263,13 +289,14 @@ SealBFVCiphertext & SealBFVCiphertext::operator *=(int a)
 SealBFVCiphertext & SealBFVCiphertext::operator -=(int a)
 {
     keys->sub_inplace(ct, a);
-    counters[PT_SUB]++;
+    count(PT_SUB);
     newId();
     return *this;
 }
 
 SealBFVCiphertext & SealBFVCiphertext::operator ^=(int e)
 {
+    relinearize();
     ct = pow(ct, e);
     newId();
     return *this;
@@ -277,17 +304,19 @@ SealBFVCiphertext & SealBFVCiphertext::operator ^=(int e)
 
 SealBFVCiphertext & SealBFVCiphertext::operator <<=(int s) // rotate rows left
 {
+    relinearize();
     keys->rotate_rows_inplace(ct, s);
-    counters[ROT_ROW] += math::ones( math::abs(s) );
+    count(ROT_ROW, math::ones( math::abs(s) ));
     newId();
     return *this;
 }
 
 SealBFVCiphertext & SealBFVCiphertext::operator >>=(int s) // rotate rows right
 {
+    relinearize();
     s = -s;
     keys->rotate_rows_inplace(ct, s);
-    counters[ROT_ROW] += math::ones( math::abs(s) );
+    count(ROT_ROW, math::ones( math::abs(s) ));
     newId();
     return *this;
 }
@@ -295,7 +324,7 @@ SealBFVCiphertext & SealBFVCiphertext::operator >>=(int s) // rotate rows right
 SealBFVCiphertext & SealBFVCiphertext::operator +=(uint64_t a)
 {
     keys->add_inplace(ct, a);
-    counters[PT_ADD]++;
+    count(PT_ADD);
     newId();
     return *this;
 }
@@ -303,7 +332,7 @@ SealBFVCiphertext & SealBFVCiphertext::operator +=(uint64_t a)
 SealBFVCiphertext & SealBFVCiphertext::operator *=(uint64_t a)
 {
     keys->mul_inplace(ct, a);
-    counters[PT_MUL]++;
+    count(PT_MUL);
     newId();
     return *this;
 }
@@ -311,7 +340,7 @@ SealBFVCiphertext & SealBFVCiphertext::operator *=(uint64_t a)
 SealBFVCiphertext & SealBFVCiphertext::operator -=(uint64_t a)
 {
     keys->sub_inplace(ct, a);
-    counters[PT_SUB]++;
+    count(PT_SUB);
     newId();
     return *this;
 }
@@ -327,7 +356,7 @@ SealBFVCiphertext SealBFVCiphertext::operator -() const
     SealBFVCiphertext r;
     r.keys = keys;
     r.ct = keys->negate(ct);
-    counters[PT_SUB]++;
+    count(PT_SUB);
     return r;
 }
 
@@ -335,98 +364,101 @@ SealBFVCiphertext SealBFVCiphertext::operator !() const // rotate columns
 {
     SealBFVCiphertext r;
     r.keys = keys;
-    r.ct = keys->rotate_columns(ct);
-    counters[ROT_COL]++;
+    Ciphertext tmp;
+    r.ct = keys->rotate_columns( linear(tmp) );
+    count(ROT_COL);
     return r;
 }
 
-SealBFVCiphertext SealBFVCiphertext::operator +(const SealBFVCiphertext & a) const
+SealBFVCiphertext SealBFVCiphertext::operator +(const SealBFVCiphertext & a) const &
 {
     SealBFVCiphertext r;
     r.keys = keys;
     r.ct = keys->add(ct, a.ct);
-    counters[CT_ADD]++;
+    count(CT_ADD);
     return r;
 }
 
-SealBFVCiphertext SealBFVCiphertext::operator *(const SealBFVCiphertext & a) const
+SealBFVCiphertext SealBFVCiphertext::operator *(const SealBFVCiphertext & a) const &
 {
     SealBFVCiphertext r;
     r.keys = keys;
+    Ciphertext tmp;
     if (id == a.id)
     {
-        r.ct = keys->square(ct);
-        counters[SQ]++;
+        r.ct = keys->square( linear(tmp) );
+        count(SQ);
     }
     else
     {
-        r.ct = keys->mul(ct, a.ct);
-        counters[CT_MUL]++;
+        Ciphertext tmpa;
+        r.ct = keys->mul( linear(tmp), a.linear(tmpa) );
+        count(CT_MUL);
     }
-    keys->relinearize_inplace(r.ct);
+    relinearizeProduct(r.ct);
     return r;
 }
 
-SealBFVCiphertext SealBFVCiphertext::operator -(const SealBFVCiphertext & a) const
+SealBFVCiphertext SealBFVCiphertext::operator -(const SealBFVCiphertext & a) const &
 {
     SealBFVCiphertext r;
     r.keys = keys;
     r.ct = keys->sub(ct, a.ct);
-    counters[CT_SUB]++;
+    count(CT_SUB);
     return r;
 }
 
-SealBFVCiphertext SealBFVCiphertext::operator +(const SealBFVPlaintext & a) const
+SealBFVCiphertext SealBFVCiphertext::operator +(const SealBFVPlaintext & a) const &
 {
     SealBFVCiphertext r;
     r.keys = keys;
     r.ct = keys->add(ct, a.pt);
-    counters[PT_ADD]++;
+    count(PT_ADD);
     return r;
 }
 
-SealBFVCiphertext SealBFVCiphertext::operator *(const SealBFVPlaintext & a) const
+SealBFVCiphertext SealBFVCiphertext::operator *(const SealBFVPlaintext & a) const &
 {
     SealBFVCiphertext r;
     r.keys = keys;
     r.ct = keys->mul(ct, a.pt);
-    counters[PT_MUL]++;
+    count(PT_MUL);
     return r;
 }
 
-SealBFVCiphertext SealBFVCiphertext::operator -(const SealBFVPlaintext & a) const
+SealBFVCiphertext SealBFVCiphertext::operator -(const SealBFVPlaintext & a) const &
 {
     SealBFVCiphertext r;
     r.keys = keys;
     r.ct = keys->sub(ct, a.pt);
-    counters[PT_SUB]++;
+    count(PT_SUB);
     return r;
 }
 
-SealBFVCiphertext SealBFVCiphertext::operator +(int a) const
+SealBFVCiphertext SealBFVCiphertext::operator +(int a) const &
 {
     SealBFVCiphertext r;
     r.keys = keys;
     r.ct = keys->add(ct, a);
-    counters[PT_ADD]++;
+    count(PT_ADD);
     return r;
 }
 
-SealBFVCiphertext SealBFVCiphertext::operator *(int a) const
+SealBFVCiphertext SealBFVCiphertext::operator *(int a) const &
 {
     SealBFVCiphertext r;
     r.keys = keys;
     r.ct = keys->mul(ct, a);
-    counters[PT_MUL]++;
+    count(PT_MUL);
     return r;
 }
 
-SealBFVCiphertext SealBFVCiphertext::operator -(int a) const
+SealBFVCiphertext SealBFVCiphertext::operator -(int a) const &
 {
     SealBFVCiphertext r;
     r.keys = keys;
     r.ct = keys->sub(ct, a);
-    counters[PT_SUB]++;
+    count(PT_SUB);
     return r;
 }
 
@@ -441,8 +473,9 @@ SealBFVCiphertext SealBFVCiphertext::operator <<(int s) const // rotate rows lef
 {
     SealBFVCiphertext r;
     r.keys = keys;
-    r.ct = keys->rotate_rows(ct, s);
-    counters[ROT_ROW] += math::ones( math::abs(s) );
+    Ciphertext tmp;
+    r.ct = keys->rotate_rows(linear(tmp), s);
+    count(ROT_ROW, math::ones( math::abs(s) ));
     return r;
 }
 
@@ -451,38 +484,100 @@ SealBFVCiphertext SealBFVCiphertext::operator >>(int s) const // rotate rows rig
     SealBFVCiphertext r;
     r.keys = keys;
     s = -s;
-    r.ct = keys->rotate_rows(ct, s);
-    counters[ROT_ROW] += math::ones( math::abs(s) );
+    Ciphertext tmp;
+    r.ct = keys->rotate_rows(linear(tmp), s);
+    count(ROT_ROW, math::ones( math::abs(s) ));
     return r;
 }
 
-SealBFVCiphertext SealBFVCiphertext::operator +(uint64_t a) const
+SealBFVCiphertext SealBFVCiphertext::operator +(uint64_t a) const &
 {
     SealBFVCiphertext r;
     r.keys = keys;
     r.ct = keys->add(ct, a);
-    counters[PT_ADD]++;
+    count(PT_ADD);
     return r;
 }
 
-SealBFVCiphertext SealBFVCiphertext::operator *(uint64_t a) const
+SealBFVCiphertext SealBFVCiphertext::operator *(uint64_t a) const &
 {
     SealBFVCiphertext r;
     r.keys = keys;
     r.ct = keys->mul(ct, a);
-    counters[PT_MUL]++;
+    count(PT_MUL);
     return r;
 }
 
-SealBFVCiphertext SealBFVCiphertext::operator -(uint64_t a) const
+SealBFVCiphertext SealBFVCiphertext::operator -(uint64_t a) const &
 {
     SealBFVCiphertext r;
     r.keys = keys;
     r.ct = keys->sub(ct, a);
-    counters[PT_SUB]++;
+    count(PT_SUB);
     return r;
 }
 
+// operators on expiring ciphertexts
+SealBFVCiphertext SealBFVCiphertext::operator +(const SealBFVCiphertext & a) &&
+{
+    return std::move(*this += a);
+}
+
+SealBFVCiphertext SealBFVCiphertext::operator *(const SealBFVCiphertext & a) &&
+{
+    return std::move(*this *= a);
+}
+
+SealBFVCiphertext SealBFVCiphertext::operator -(const SealBFVCiphertext & a) &&
+{
+    return std::move(*this -= a);
+}
+
+SealBFVCiphertext SealBFVCiphertext::operator +(int a) &&
+{
+    return std::move(*this += a);
+}
+
+SealBFVCiphertext SealBFVCiphertext::operator *(int a) &&
+{
+    return std::move(*this *= a);
+}
+
+SealBFVCiphertext SealBFVCiphertext::operator -(int a) &&
+{
+    return std::move(*this -= a);
+}
+
+SealBFVCiphertext SealBFVCiphertext::operator +(const SealBFVPlaintext & a) &&
+{
+    return std::move(*this += a);
+}
+
+SealBFVCiphertext SealBFVCiphertext::operator *(const SealBFVPlaintext & a) &&
+{
+    return std::move(*this *= a);
+}
+
+SealBFVCiphertext SealBFVCiphertext::operator -(const SealBFVPlaintext & a) &&
+{
+    return std::move(*this -= a);
+}
+
+SealBFVCiphertext SealBFVCiphertext::operator +(uint64_t a) &&
+{
+    return std::move(*this += a);
+}
+
+SealBFVCiphertext SealBFVCiphertext::operator *(uint64_t a) &&
+{
+    return std::move(*this *= a);
+}
+
+SealBFVCiphertext SealBFVCiphertext::operator -(uint64_t a) &&
+{
+    return std::move(*this -= a);
+}
+
 SealBFVCiphertext operator+(const SealBFVPlaintext & a, const SealBFVCiphertext & b)
 {
     return b + a;
@@ -528,6 +623,13 @@ SealBFVCiphertext operator-(uint64_t a, const SealBFVCiphertext & b)
     return -b + a;
 }
 
+// memory held by the coefficients: one word per coefficient, for each
+// polynomial and each prime of the current modulus
+size_t SealBFVCiphertext::byteSize() const
+{
+    return ct.size() * ct.poly_modulus_degree() * ct.coeff_modulus_size() * sizeof(uint64_t);
+}
+
 std::vector<uint64_t> SealBFVCiphertext::decode() const
 {
     return keys->decode(ct);
@@ -554,11 +656,28 @@ std::shared_ptr<SealBFVKeys> SealBFVCiphertext::getKeys() const
     return keys;
 }
 
+// Size-2 form of the ciphertext for operations that need it (products and
+// rotations). A pending relinearization is applied on a copy in tmp, so
+// const operands shared by other ciphertexts are never modified.
+const Ciphertext & SealBFVCiphertext::linear(Ciphertext & tmp) const
+{
+    if ( ct.size() <= 2 ) return ct;
+    tmp = ct;
+    keys->relinearize_inplace(tmp);
+    count(RELIN);
+    return tmp;
+}
+
 void SealBFVCiphertext::newId()
 {
     id = id_counter++;
 }
 
+bool SealBFVCiphertext::pendingRelinearization() const
+{
+    return ct.size() > 2;
+}
+
 int SealBFVCiphertext::plaintextModulus() const
 {
     return keys->plaintextModulus();
@@ -569,45 +688,100 @@ int SealBFVCiphertext::polynomialDegree() const
     return keys->polynomialDegree();
 }
 
+// With LAZY_RELIN=1 a product keeps its size-3 ciphertext. Additions and
+// plaintext operations accept it as is, and it is relinearized at the next
+// product or rotation, or when a sum of products is complete.
+void SealBFVCiphertext::relinearize()
+{
+    if ( ct.size() <= 2 ) return;
+    keys->relinearize_inplace(ct);
+    count(RELIN);
+}
+
+// compression, where SEAL was built with it, trades CPU for fewer bytes
+void SealBFVCiphertext::save(ostream & out, bool compress) const
+{
+    ct.save( out, compress ? Serialization::compr_mode_default : compr_mode_type::none );
+}
+
+void SealBFVCiphertext::relinearizeProduct(Ciphertext & c) const
+{
+#if (LAZY_RELIN == 0)
+    keys->relinearize_inplace(c);
+    count(RELIN);
+#endif
+}
+
 Ciphertext SealBFVCiphertext::pow(const Ciphertext & b, int e)
 {
     if (e < 0) throw "Exponent must be non-negative";
     if (e == 0) return keys->encrypt(1);
     if (e == 1) return b;
-    counters[SQ]++;
+    count(SQ);
     auto r = keys->square(b);
     keys->relinearize_inplace(r);
+    count(RELIN);
     if (e > 3) r = pow(r, e>>1);
     if (e & 1)
     {
         keys->mul_inplace(r, b);
         keys->relinearize_inplace(r);
-        counters[CT_MUL]++;
+        count(CT_MUL);
+        count(RELIN);
     }
     return r;
 }
 
 SealBFVCiphertext SealBFVCiphertext::add_many(const vector<SealBFVCiphertext> & v)
+{
+    vector<const SealBFVCiphertext *> vp;
+    for (auto & e : v) vp.push_back(&e);
+    return add_many(vp);
+}
+
+// accumulates into one ciphertext, without copying the operands
+SealBFVCiphertext SealBFVCiphertext::add_many(const vector<const SealBFVCiphertext *> & v)
 {
     if ( v.empty() ) return SealBFVCiphertext(0);
     SealBFVCiphertext r;
-    r.keys = v[0].keys;
-    vector<Ciphertext> vct;
-    for (auto & e : v) vct.push_back(e.ct);
-    r.ct = r.keys->add_many(vct);
-    counters[CT_ADD] += v.size() - 1;
+    r.keys = v[0]->keys;
+    r.ct = v[0]->ct;
+    for ( size_t i=1; i<v.size(); i++ ) r.keys->add_inplace(r.ct, v[i]->ct);
+    count(CT_ADD, v.size() - 1);
     return r;
 }
 
 SealBFVKeys SealBFVCiphertext::defaultKeys(const SealBFVKeys & keys)
 {
-    default_keys = make_shared<SealBFVKeys>(keys);
+    default_keys = SealBFVKeys::share(keys);
     return *default_keys;
 }
 
 vector<int> SealBFVCiphertext::getCounters()
 {
-    return counters;
+    return vector<int>( counters.begin(), counters.end() );
+}
+
+void SealBFVCiphertext::count(int counter, int n)
+{
+    if (counting) counters[counter] += n;
+}
+
+// Turns counting on or off for the operations of the calling thread only,
+// e.g. to keep calibration out of the counters, and returns the last state.
+bool SealBFVCiphertext::setCounting(bool on)
+{
+    bool was = counting;
+    counting = on;
+    return was;
+}
+
+SealBFVCiphertext SealBFVCiphertext::load(istream & in, const shared_ptr<SealBFVKeys> & keys)
+{
+    SealBFVCiphertext r;
+    r.keys = keys;
+    r.ct = keys->loadCiphertext(in);
+    return r;
 }
 
 SealBFVCiphertext SealBFVCiphertext::mul_many(const vector<SealBFVCiphertext> & v)
@@ -618,7 +792,7 @@ SealBFVCiphertext SealBFVCiphertext::mul_many(const vector<SealBFVCiphertext> &
     vector<Ciphertext> vct;
     for (auto & e : v) vct.push_back(e.ct);
     r.ct = r.keys->mul_many(vct);
-    counters[CT_MUL] += v.size() - 1;
+    count(CT_MUL, v.size() - 1);
     return r;
 }
 
@@ -633,6 +807,11 @@ ostream & operator <<(ostream & os, const SealBFVCiphertext & a)
     return os << string(a);
 }
 
+void relinearize(SealBFVCiphertext & c)
+{
+    c.relinearize();
+}
+
 } // seal wrapper
 
 namespace std
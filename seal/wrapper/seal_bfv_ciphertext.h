@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -9,7 +10,11 @@
 #include "seal_bfv_keys.h"
 #include "seal_bfv_plaintext.h"
 
-extern int nativeCopyCounter;
+#ifndef LAZY_RELIN
+    #define LAZY_RELIN 0
+#endif
+
+extern std::atomic<int> nativeCopyCounter;
 
 namespace seal_wrapper
 {
@@ -21,13 +26,17 @@ class SealBFVCiphertext
         int id;
         std::shared_ptr<SealBFVKeys> keys;
 
-        static std::vector<int> counters;
+        static std::vector<std::atomic<int>> counters;
         static std::shared_ptr<SealBFVKeys> default_keys;
-        static int id_counter;
+        static std::atomic<int> id_counter;
         static PrintingMode printing_mode;
+        static thread_local bool counting;
 
+        static void count(int counter, int n = 1);
+        const seal::Ciphertext & linear(seal::Ciphertext &) const;
         void newId();
         seal::Ciphertext pow(const seal::Ciphertext &, int);
+        void relinearizeProduct(seal::Ciphertext &) const;
 
     public:
         SealBFVCiphertext();
@@ -37,6 +46,7 @@ class SealBFVCiphertext
         SealBFVCiphertext(const std::vector<uint64_t> &);
         SealBFVCiphertext(const SealBFVPlaintext &);
         SealBFVCiphertext(const SealBFVCiphertext &);
+        SealBFVCiphertext(SealBFVCiphertext &&) noexcept;
         SealBFVCiphertext(int, const SealBFVKeys &);
         SealBFVCiphertext(int, const std::shared_ptr<SealBFVKeys> &);
         SealBFVCiphertext(uint64_t, const SealBFVKeys &);
@@ -53,6 +63,9 @@ class SealBFVCiphertext
         explicit operator SealBFVPlaintext() const;
         explicit operator std::string() const;
 
+        SealBFVCiphertext & operator =(const SealBFVCiphertext &);
+        SealBFVCiphertext & operator =(SealBFVCiphertext &&) noexcept;
+
         // compound assignment operators
         SealBFVCiphertext & operator~(); // negate_inplace
         SealBFVCiphertext & operator++();
@@ -84,24 +97,38 @@ class SealBFVCiphertext
         SealBFVCiphertext operator -() const; // negate
         SealBFVCiphertext operator !() const; // rotate columns
 
-        SealBFVCiphertext operator +(const SealBFVCiphertext &) const;
-        SealBFVCiphertext operator *(const SealBFVCiphertext &) const;
-        SealBFVCiphertext operator -(const SealBFVCiphertext &) const;
+        SealBFVCiphertext operator +(const SealBFVCiphertext &) const &;
+        SealBFVCiphertext operator *(const SealBFVCiphertext &) const &;
+        SealBFVCiphertext operator -(const SealBFVCiphertext &) const &;
 
-        SealBFVCiphertext operator +(const SealBFVPlaintext &) const;
-        SealBFVCiphertext operator *(const SealBFVPlaintext &) const;
-        SealBFVCiphertext operator -(const SealBFVPlaintext &) const;
+        SealBFVCiphertext operator +(const SealBFVPlaintext &) const &;
+        SealBFVCiphertext operator *(const SealBFVPlaintext &) const &;
+        SealBFVCiphertext operator -(const SealBFVPlaintext &) const &;
 
-        SealBFVCiphertext operator +(int) const;
-        SealBFVCiphertext operator *(int) const;
-        SealBFVCiphertext operator -(int) const;
+        SealBFVCiphertext operator +(int) const &;
+        SealBFVCiphertext operator *(int) const &;
+        SealBFVCiphertext operator -(int) const &;
         SealBFVCiphertext operator ^(int) const; // exponentation
         SealBFVCiphertext operator <<(int) const; // rotate rows left
         SealBFVCiphertext operator >>(int) const; // rotate rows right
 
-        SealBFVCiphertext operator +(uint64_t) const;
-        SealBFVCiphertext operator *(uint64_t) const;
-        SealBFVCiphertext operator -(uint64_t) const;
+        SealBFVCiphertext operator +(uint64_t) const &;
+        SealBFVCiphertext operator *(uint64_t) const &;
+        SealBFVCiphertext operator -(uint64_t) const &;
+
+        // operators on expiring ciphertexts, computed in their buffers
+        SealBFVCiphertext operator +(const SealBFVCiphertext &) &&;
+        SealBFVCiphertext operator *(const SealBFVCiphertext &) &&;
+        SealBFVCiphertext operator -(const SealBFVCiphertext &) &&;
+        SealBFVCiphertext operator +(int) &&;
+        SealBFVCiphertext operator *(int) &&;
+        SealBFVCiphertext operator -(int) &&;
+        SealBFVCiphertext operator +(const SealBFVPlaintext &) &&;
+        SealBFVCiphertext operator *(const SealBFVPlaintext &) &&;
+        SealBFVCiphertext operator -(const SealBFVPlaintext &) &&;
+        SealBFVCiphertext operator +(uint64_t) &&;
+        SealBFVCiphertext operator *(uint64_t) &&;
+        SealBFVCiphertext operator -(uint64_t) &&;
 
         friend SealBFVCiphertext operator+(const SealBFVPlaintext &, const SealBFVCiphertext &);
         friend SealBFVCiphertext operator*(const SealBFVPlaintext &, const SealBFVCiphertext &);
@@ -115,22 +142,31 @@ class SealBFVCiphertext
         friend SealBFVCiphertext operator*(uint64_t, const SealBFVCiphertext &);
         friend SealBFVCiphertext operator-(uint64_t, const SealBFVCiphertext &);
 
+        size_t byteSize() const;
         std::vector<uint64_t> decode() const;
         std::vector<int> decode_int() const;
         SealBFVPlaintext decrypt() const;
         std::shared_ptr<SealBFVKeys> getKeys() const;
+        bool pendingRelinearization() const;
         int plaintextModulus() const;
         int polynomialDegree() const;
+        void relinearize();
+        void save(std::ostream &, bool compress = false) const;
 
         static SealBFVCiphertext add_many(const std::vector<SealBFVCiphertext> &);
+        static SealBFVCiphertext add_many(const std::vector<const SealBFVCiphertext *> &);
         static SealBFVKeys defaultKeys(const SealBFVKeys & keys = *default_keys);
         static std::vector<int> getCounters();
+        static SealBFVCiphertext load(std::istream &, const std::shared_ptr<SealBFVKeys> &);
         static SealBFVCiphertext mul_many(const std::vector<SealBFVCiphertext> &);
+        static bool setCounting(bool);
         static PrintingMode printingMode(const PrintingMode & = printing_mode);
 
         friend std::ostream & operator <<(std::ostream & os, const SealBFVCiphertext &);
 };
 
+void relinearize(SealBFVCiphertext &);
+
 } // seal_wrapper
 
 namespace std
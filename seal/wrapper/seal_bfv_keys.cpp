@@ -1,6 +1,18 @@
 #include "seal_bfv_keys.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <streambuf>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace seal;
 using namespace std;
@@ -8,68 +20,101 @@ using namespace std;
 namespace seal_wrapper
 {
 
+static mutex contexts_mutex;
+static map<pair<int, int>, weak_ptr<SEALContext>> contexts; // by n and t
+
+static mutex shared_mutex;
+static weak_ptr<SealBFVKeys> empty_keys; // shared instance of the empty key set
+
+// Binary key file: a header, a table of sections and the keys serialized by
+// SEAL, each in its section.
+static const char MAGIC[8] = {'F', 'U', 'R', 'B', 'O', 'K', 'E', 'Y'};
+enum Kind { SK=0, PK, RK, GK_ALL, GK_STEP };
+
+struct FileHeader
+{
+    char magic[8];
+    int32_t n;
+    int32_t t;
+    uint32_t count; // sections
+};
+
+struct FileSection
+{
+    int32_t kind;
+    int32_t step; // of GK_STEP
+    uint64_t offset;
+    uint64_t size;
+};
+
+// reads a mapped section in place
+class MemoryBuffer : public streambuf
+{
+    public:
+        MemoryBuffer(const char * data, size_t size)
+        {
+            auto p = const_cast<char *>(data);
+            setg(p, p, p + size);
+        }
+
+    protected:
+        pos_type seekoff(off_type off, ios_base::seekdir dir, ios_base::openmode) override
+        {
+            char * p = dir == ios_base::beg ? eback() : dir == ios_base::cur ? gptr() : egptr();
+            p += off;
+            if ( p < eback() || p > egptr() ) return pos_type( off_type(-1) );
+            setg(eback(), p, egptr());
+            return pos_type( p - eback() );
+        }
+
+        pos_type seekpos(pos_type pos, ios_base::openmode mode) override
+        {
+            return seekoff(off_type(pos), ios_base::beg, mode);
+        }
+};
+
+SealBFVKeys::Impl::~Impl()
+{
+    if (file) munmap(const_cast<char *>(file), file_size);
+}
+
 SealBFVKeys::SealBFVKeys(int n, int t)
 {
     generate(n, t);
 }
 
+SealBFVKeys::SealBFVKeys(int n, int t, const vector<int> & steps)
+{
+    generate(n, t, steps);
+}
+
 SealBFVKeys::SealBFVKeys(int n, int t, const SecretKey & sk,
     const PublicKey & pk, const RelinKeys & rk, const GaloisKeys & gk)
 {
-    this->n = n;
-    this->t = t;
-    createContext();
-    this->sk = sk;
-    this->pk = pk;
-    this->rk = rk;
-    this->gk = gk;
-    enc = new Encryptor(*context, pk);
-    dec = new Decryptor(*context, sk);
-    eval = new Evaluator(*context);
-    encoder = new BatchEncoder(*context);
-    zero = encrypt(0);
-}
-
-SealBFVKeys::SealBFVKeys(const SealBFVKeys & keys)
-    : SealBFVKeys(keys.n, keys.t, keys.sk, keys.pk, keys.rk, keys.gk)
-{}
-
-SealBFVKeys::~SealBFVKeys()
-{
-    free(enc);
-    free(dec);
-    free(eval);
-    free(encoder);
-}
-
-SealBFVKeys & SealBFVKeys::operator =(const SealBFVKeys & keys)
-{
-    this->n = keys.n;
-    this->t = keys.t;
-    createContext();
-    this->sk = keys.sk;
-    this->pk = keys.pk;
-    this->rk = keys.rk;
-    this->gk = keys.gk;
-    enc = new Encryptor(*context, pk);
-    dec = new Decryptor(*context, sk);
-    eval = new Evaluator(*context);
-    encoder = new BatchEncoder(*context);
-    this->zero = keys.zero;
-    return *this;
+    auto keys = make_unique<Impl>();
+    keys->n = n;
+    keys->t = t;
+    keys->context = createContext(n, t);
+    keys->sk = sk;
+    keys->pk = pk;
+    keys->rk = rk;
+    keys->has_rk = true;
+    keys->gk = gk;
+    keys->has_gk = true;
+    impl = finish( move(keys), true, true );
 }
 
 Ciphertext SealBFVKeys::add(const Ciphertext & ct1, const Ciphertext & ct2)
 {
     Ciphertext cto;
-    eval->add(ct1, ct2, cto);
+    impl->eval->add(ct1, ct2, cto);
     return cto;
 }
 
 Ciphertext SealBFVKeys::add(const Ciphertext & ct, const Plaintext & pt)
 {
     Ciphertext cto;
-    eval->add_plain(ct, pt, cto);
+    impl->eval->add_plain(ct, pt, cto);
     return cto;
 }
 
@@ -85,46 +130,67 @@ Ciphertext SealBFVKeys::add(const Ciphertext & ct, uint64_t s)
 
 void SealBFVKeys::add_inplace(Ciphertext & ct1, const Ciphertext & ct2)
 {
-    eval->add_inplace(ct1, ct2);
+    impl->eval->add_inplace(ct1, ct2);
 }
 
 void SealBFVKeys::add_inplace(Ciphertext & ct, const Plaintext & pt)
 {
-    eval->add_plain_inplace(ct, pt);
+    impl->eval->add_plain_inplace(ct, pt);
 }
 
 void SealBFVKeys::add_inplace(Ciphertext & ct, int s)
 {
-    eval->add_plain_inplace( ct, encode(s) );
+    impl->eval->add_plain_inplace( ct, encode(s) );
 }
 
 void SealBFVKeys::add_inplace(Ciphertext & ct, uint64_t s)
 {
-    eval->add_plain_inplace( ct, encode(s) );
+    impl->eval->add_plain_inplace( ct, encode(s) );
 }
 
 Ciphertext SealBFVKeys::add_many(const vector<Ciphertext> & vct)
 {
     Ciphertext cto;
-    eval->add_many(vct, cto);
+    impl->eval->add_many(vct, cto);
     return cto;
 }
 
-void SealBFVKeys::createContext()
+// Pool of the temporaries of an evaluation, all freed before it returns. With
+// SEAL_POOL=1 each thread has a pool of its own, which takes no lock; SEAL's
+// thread-local pools must not be shared, so the ciphertexts themselves, which
+// other threads copy and free, keep coming from the global pool.
+static MemoryPoolHandle scratch()
+{
+#if (SEAL_POOL == 1)
+    return MemoryManager::GetPool(mm_prof_opt::mm_force_thread_local);
+#else
+    return MemoryManager::GetPool();
+#endif
+}
+
+// one context per parameter set, shared by the key sets that use it
+shared_ptr<SEALContext> SealBFVKeys::createContext(int n, int t)
 {
-    params = EncryptionParameters(scheme_type::bfv);
+    lock_guard<mutex> lock(contexts_mutex);
+    auto & weak = contexts[{n, t}];
+    auto context = weak.lock();
+    if (context) return context;
+
+    auto params = EncryptionParameters(scheme_type::bfv);
     params.set_poly_modulus_degree(n);
     params.set_coeff_modulus(CoeffModulus::BFVDefault(n));
     params.set_plain_modulus(t);
     context = make_shared<SEALContext>( SEALContext(params) );
     auto qualifiers = context->first_context_data()->qualifiers();
     if (!qualifiers.using_batching) throw "The plaintext modulus specified does not allow batching";
+    weak = context;
+    return context;
 }
 
 vector<uint64_t> SealBFVKeys::decode(const Plaintext & pt)
 {
     vector<uint64_t> v;
-    encoder->decode(pt, v);
+    impl->encoder->decode(pt, v);
     return v;
 }
 
@@ -135,19 +201,26 @@ vector<uint64_t> SealBFVKeys::decode(const Ciphertext & ct)
 
 Plaintext SealBFVKeys::decrypt(const Ciphertext & ct)
 {
+    if (!impl->dec) throw "Decryption requires the secret key";
     Plaintext pt;
-    dec->decrypt(ct, pt);
+    impl->dec->decrypt(ct, pt);
     return pt;
 }
 
 Plaintext SealBFVKeys::encode(int s)
 {
-    return encode( vector<uint64_t>( n, uint64_t(reduce(s)) ) );
+    return encode( uint64_t(reduce(s)) );
 }
 
+// Batching the same value in every slot yields the constant polynomial s,
+// so it is written directly instead of running the encoder on n copies.
+// It is kept in coefficient form: SEAL multiplies a single-coefficient
+// plaintext as a scalar, which is cheaper than an NTT-form product.
 Plaintext SealBFVKeys::encode(uint64_t s)
 {
-    return encode( vector<uint64_t>(n,s) );
+    Plaintext pt(1);
+    pt[0] = s % impl->t;
+    return pt;
 }
 
 Plaintext SealBFVKeys::encode(const vector<int> & v)
@@ -155,21 +228,22 @@ Plaintext SealBFVKeys::encode(const vector<int> & v)
     Plaintext pt;
     vector<uint64_t> vu;
     for (auto e : v) vu.push_back( uint64_t(reduce(e)) );
-    encoder->encode(vu, pt);
+    impl->encoder->encode(vu, pt);
     return pt;
 }
 
 Plaintext SealBFVKeys::encode(const vector<uint64_t> & v)
 {
     Plaintext pt;
-    encoder->encode(v, pt);
+    impl->encoder->encode(v, pt);
     return pt;
 }
 
 Ciphertext SealBFVKeys::encrypt(const Plaintext & pt)
 {
+    if (!impl->enc) throw "Encryption requires the public key";
     Ciphertext ct;
-    enc->encrypt(pt, ct);
+    impl->enc->encrypt(pt, ct);
     return ct;
 }
 
@@ -193,24 +267,108 @@ Ciphertext SealBFVKeys::encrypt(const vector<uint64_t> & v)
     return encrypt( encode(v) );
 }
 
-void SealBFVKeys::generate(int n, int t)
+// builds the objects that work on the keys, once the keys are set
+shared_ptr<const SealBFVKeys::Impl> SealBFVKeys::finish(unique_ptr<Impl> keys, bool encrypt, bool decrypt)
+{
+    auto & context = *keys->context;
+    if (encrypt) keys->enc = make_unique<Encryptor>(context, keys->pk);
+    if (decrypt) keys->dec = make_unique<Decryptor>(context, keys->sk);
+    if (decrypt) keys->sym = make_unique<Encryptor>(context, keys->sk);
+    keys->eval = make_unique<Evaluator>(context);
+    keys->encoder = make_unique<BatchEncoder>(context);
+    keys->galois_found = make_unique<atomic<const GaloisKeys *>[]>(keys->n / 2);
+    if (encrypt)
+    {
+        Plaintext pt(1);
+        keys->enc->encrypt(pt, keys->zero);
+    }
+    return shared_ptr<const Impl>( move(keys) );
+}
+
+// Galois keys of a rotation step (0: columns). The keys of a step used for
+// the first time are read from the key file or generated from the secret
+// key, unless there is a whole set, from which SEAL composes every step.
+// Keys are never replaced once made, so later uses of the step find them
+// without locking.
+const GaloisKeys & SealBFVKeys::galoisKeys(int step) const
+{
+    auto & found = impl->galois_found[step];
+    if ( auto keys = found.load(memory_order_acquire) ) return *keys;
+    lock_guard<mutex> lock(impl->lazy_mutex);
+    auto & keys = lockedGaloisKeys(step);
+    found.store(&keys, memory_order_release);
+    return keys;
+}
+
+// galoisKeys with lazy_mutex held
+const GaloisKeys & SealBFVKeys::lockedGaloisKeys(int step) const
+{
+    auto it = impl->galois.find(step);
+    if ( it != impl->galois.end() ) return it->second;
+    GaloisKeys gk;
+    if ( loadSection(*impl, gk, GK_STEP, step) ) return impl->galois[step] = move(gk);
+    if ( !impl->has_gk ) impl->has_gk = loadSection(*impl, impl->gk, GK_ALL);
+    if (impl->has_gk) return impl->gk;
+    if (!impl->dec) throw "Rotations require Galois keys or the secret key";
+
+    KeyGenerator keygen(*impl->context, impl->sk);
+    keygen.create_galois_keys(vector<int>{step}, gk);
+    return impl->galois[step] = move(gk);
+}
+
+// relinearization keys, read from the key file or generated on first use
+const RelinKeys & SealBFVKeys::relinKeys() const
+{
+    if (impl->has_rk) return impl->rk;
+    lock_guard<mutex> lock(impl->lazy_mutex);
+    if (impl->has_rk) return impl->rk;
+    if ( !loadSection(*impl, impl->rk, RK) )
+    {
+        if (!impl->dec) throw "Relinearization requires relinearization keys or the secret key";
+        KeyGenerator keygen(*impl->context, impl->sk);
+        keygen.create_relin_keys(impl->rk);
+    }
+    impl->has_rk = true;
+    return impl->rk;
+}
+
+// reads a key from its section of the mapped key file; false if absent
+template <class Key>
+bool SealBFVKeys::loadSection(const Impl & keys, Key & key, int kind, int step)
+{
+    auto it = keys.sections.find({kind, step});
+    if ( it == keys.sections.end() ) return false;
+    MemoryBuffer buffer(keys.file + it->second.offset, it->second.size);
+    istream in(&buffer);
+    try { key.load(*keys.context, in); }
+    catch (...) { return false; }
+    return true;
+}
+
+// Galois keys are generated for the steps given (0: columns), others when used
+void SealBFVKeys::generate(int n, int t, const vector<int> & steps)
 {
-    this->n = n;
-    this->t = t;
-    createContext();
-    KeyGenerator keygen(*context);
-    sk = keygen.secret_key();
-    keygen.create_public_key(pk);
-    keygen.create_relin_keys(rk);
-    keygen.create_galois_keys(gk);
-    enc = new Encryptor(*context, pk);
-    dec = new Decryptor(*context, sk);
-    eval = new Evaluator(*context);
-    encoder = new BatchEncoder(*context);
+    auto keys = make_unique<Impl>();
+    keys->n = n;
+    keys->t = t;
+    keys->context = createContext(n, t);
+    KeyGenerator keygen(*keys->context);
+    keys->sk = keygen.secret_key();
+    keygen.create_public_key(keys->pk);
+    int half = n >> 1;
+    for (auto s : steps)
+    {
+        int step = (s % half + half) % half; // as rowStep does
+        if ( !keys->galois.count(step) ) keygen.create_galois_keys( vector<int>{step}, keys->galois[step] );
+    }
+    impl = finish( move(keys), true, true );
 }
 
 bool SealBFVKeys::load(const string & filename)
 {
+    auto keys = make_unique<Impl>();
+    bool encrypt = true, decrypt = true;
+    vector<int> steps;
     string fname;
     // n, t
     try
@@ -218,9 +376,14 @@ bool SealBFVKeys::load(const string & filename)
         fname = filename + ".cfg.key";
         ifstream fin(fname);
         if (fin.fail()) throw "Cannot read '" + fname + "'. Context cannot be created.";
-        fin >> n;
-        fin >> t;
-        createContext();
+        fin >> keys->n;
+        fin >> keys->t;
+        keys->context = createContext(keys->n, keys->t);
+
+        // the Galois keys saved: whether a whole set, then the steps
+        size_t nsteps = 0;
+        if ( !(fin >> keys->has_gk >> nsteps) ) keys->has_gk = true; // written before steps
+        for (int step; nsteps-- && fin >> step; ) steps.push_back(step);
     }
     catch (...) { throw "Cannot read '" + fname + "'. Context cannot be created."; }
 
@@ -229,40 +392,120 @@ bool SealBFVKeys::load(const string & filename)
     {
         fname = filename + ".sk.key";
         ifstream fin(fname);
-        sk.load(*context, fin);
+        keys->sk.load(*keys->context, fin);
+    }
+    catch (...)
+    {
+        std::cout << "WARNING: Cannot read the secret key from '" + fname + "'. Decryption will not work for this key.\n";
+        decrypt = false;
     }
-    catch (...) { std::cout << "WARNING: Cannot read the secret key from '" + fname + "'. Decryption will not work for this key.\n"; }
 
     // public key
     try
     {
         fname = filename + ".pk.key";
         ifstream fin(fname);
-        pk.load(*context, fin);
+        keys->pk.load(*keys->context, fin);
+    }
+    catch (...)
+    {
+        std::cout << "WARNING: Cannot read the public key from '" + fname + "'. Encryption will not work for this key.\n";
+        encrypt = false;
     }
-    catch (...) { std::cout << "WARNING: Cannot read the public key from '" + fname + "'. Encryption will not work for this key.\n"; }
 
     // relinearization keys
     try
     {
         fname = filename + ".rk.key";
         ifstream fin(fname);
-        rk.load(*context, fin);
+        keys->rk.load(*keys->context, fin);
+        keys->has_rk = true;
     }
-    catch (...) { std::cout << "WARNING: Cannot read the relinearization keys from '" + fname + "'. Multiplication will not work for this key.\n"; }
+    catch (...) { std::cout << "WARNING: Cannot read the relinearization keys from '" + fname + "'. Multiplication will need the secret key.\n"; }
 
     // Galois keys
     try
     {
         fname = filename + ".gk.key";
         ifstream fin(fname);
-        gk.load(*context, fin);
+        if (keys->has_gk) keys->gk.load(*keys->context, fin);
+        for (auto step : steps) keys->galois[step].load(*keys->context, fin);
+    }
+    catch (...)
+    {
+        std::cout << "WARNING: Cannot read the Galois keys from '" + fname + "'. Rotations will need the secret key.\n";
+        keys->has_gk = false;
+        keys->galois.clear();
+    }
+
+    impl = finish( move(keys), encrypt, decrypt );
+    return true;
+}
+
+// Opens a binary key file written by saveBinary. The file stays mapped: the
+// secret and public keys are read now, the relinearization and Galois keys
+// when first used.
+bool SealBFVKeys::loadBinary(const string & filename)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    void * p = MAP_FAILED;
+    if ( fstat(fd, &st) == 0 && st.st_size > 0 ) p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return false;
+
+    auto keys = make_unique<Impl>();
+    keys->file = static_cast<const char *>(p); // unmapped with keys
+    keys->file_size = st.st_size;
+    FileHeader header;
+    bool valid = keys->file_size >= sizeof header;
+    if (valid)
+    {
+        memcpy(&header, keys->file, sizeof header);
+        valid = !memcmp(header.magic, MAGIC, sizeof MAGIC)
+            && sizeof header + header.count * sizeof(FileSection) <= keys->file_size;
+    }
+    for (uint32_t i = 0; valid && i < header.count; i++)
+    {
+        FileSection section;
+        memcpy(&section, keys->file + sizeof header + i * sizeof section, sizeof section);
+        valid = section.offset <= keys->file_size && section.size <= keys->file_size - section.offset;
+        keys->sections[{section.kind, section.step}] = Section{section.offset, section.size};
+    }
+    if (!valid)
+    {
+        std::cout << "WARNING: '" + filename + "' is not a key file.\n";
+        return false;
     }
-    catch (...) { std::cout << "WARNING: Cannot read the Galois keys from '" + fname + "'. Rotations will not work for this key.\n"; }
 
+    keys->n = header.n;
+    keys->t = header.t;
+    try { keys->context = createContext(keys->n, keys->t); }
+    catch (...)
+    {
+        // a damaged header, so openKeys generates and rewrites the file
+        std::cout << "WARNING: '" + filename + "' has invalid parameters.\n";
+        return false;
+    }
+    bool decrypt = loadSection(*keys, keys->sk, SK);
+    bool encrypt = loadSection(*keys, keys->pk, PK);
+    if (!encrypt && !decrypt)
+    {
+        std::cout << "WARNING: Cannot read the keys from '" + filename + "'.\n";
+        return false;
+    }
+    impl = finish( move(keys), encrypt, decrypt );
     return true;
 }
 
+Ciphertext SealBFVKeys::loadCiphertext(istream & in) const
+{
+    Ciphertext ct;
+    ct.load(*impl->context, in);
+    return ct;
+}
+
 SealBFVKeys SealBFVKeys::loadKeys(const string & filename)
 {
     SealBFVKeys keys;
@@ -270,97 +513,162 @@ SealBFVKeys SealBFVKeys::loadKeys(const string & filename)
     return keys;
 }
 
+// reads every Galois key of the key file, so that saving keeps them
+void SealBFVKeys::loadGalois() const
+{
+    lock_guard<mutex> lock(impl->lazy_mutex);
+    for (const auto & s : impl->sections)
+    {
+        int kind = s.first.first, step = s.first.second;
+        if ( kind == GK_ALL && !impl->has_gk ) impl->has_gk = loadSection(*impl, impl->gk, GK_ALL);
+        if ( kind != GK_STEP || impl->galois.count(step) ) continue;
+        GaloisKeys gk;
+        if ( loadSection(*impl, gk, GK_STEP, step) ) impl->galois[step] = move(gk);
+    }
+}
+
 Ciphertext SealBFVKeys::mod_switch_to_next(const Ciphertext & ct)
 {
     Ciphertext cto;
-    eval->mod_switch_to_next(ct, cto);
+    impl->eval->mod_switch_to_next(ct, cto);
     return cto;
 }
 
 void SealBFVKeys::mod_switch_to_next_inplace(seal::Ciphertext & ct)
 {
-    eval->mod_switch_to_next_inplace(ct);
+    impl->eval->mod_switch_to_next_inplace(ct);
+}
+
+// The key set of n and t kept in dir: read from its binary file, or
+// generated and saved there for the next runs. Without a dir, generated.
+SealBFVKeys SealBFVKeys::openKeys(int n, int t, const string & dir)
+{
+    SealBFVKeys keys;
+    if ( dir.empty() )
+    {
+        keys.generate(n, t);
+        return keys;
+    }
+    string filename = dir + "/keys-" + to_string(n) + "-" + to_string(t) + ".bin";
+    if ( keys.loadBinary(filename) && keys.impl->n == n && keys.impl->t == t ) return keys;
+    keys.generate(n, t);
+    if ( !keys.saveBinary(filename) )
+        std::cout << "WARNING: Cannot write the keys to '" + filename + "'. They will be generated again next time.\n";
+    return keys;
+}
+
+// An encryption of zero at the level and size of ct, for products by zero.
+// Without a public key it is ct with its data cleared, which SEAL deems
+// transparent.
+Ciphertext SealBFVKeys::zeroLike(const Ciphertext & ct) const
+{
+    if ( impl->zero.size() == 0 )
+    {
+        Ciphertext cto = ct;
+        std::fill( cto.data(), cto.data() + cto.dyn_array().size(), 0 );
+        return cto;
+    }
+    Ciphertext cto = impl->zero;
+    if ( cto.parms_id() != ct.parms_id() ) impl->eval->mod_switch_to_inplace( cto, ct.parms_id(), scratch() );
+    if ( cto.size() < ct.size() ) cto.resize( ct.size() );
+    return cto;
 }
 
 Ciphertext SealBFVKeys::mul(const Ciphertext & ct1, const Ciphertext & ct2)
 {
     Ciphertext cto;
-    eval->multiply(ct1, ct2, cto);
+    impl->eval->multiply( ct1, ct2, cto, scratch() );
     return cto;
 }
 
 Ciphertext SealBFVKeys::mul(const Ciphertext & ct, const Plaintext & pt)
 {
+    if ( pt.is_zero() ) return zeroLike(ct);
+    if ( pt.is_ntt_form() )
+    {
+        Ciphertext cto = ct;
+        mul_inplace(cto, pt);
+        return cto;
+    }
     Ciphertext cto;
-    eval->multiply_plain(ct, pt, cto);
+    impl->eval->multiply_plain( ct, pt, cto, scratch() );
     return cto;
 }
 
 Ciphertext SealBFVKeys::mul(const Ciphertext & ct, int s)
 {
-    if (!s) return zero;
+    if (!s) return zeroLike(ct);
     return mul( ct, encode(s) );
 }
 
 Ciphertext SealBFVKeys::mul(const Ciphertext & ct, uint64_t s)
 {
-    if (!s) return zero;
+    if (!s) return zeroLike(ct);
     return mul( ct, encode(s) );
 }
 
 void SealBFVKeys::mul_inplace(Ciphertext & ct1, const Ciphertext & ct2)
 {
-    eval->multiply_inplace(ct1, ct2);
+    impl->eval->multiply_inplace( ct1, ct2, scratch() );
 }
 
 void SealBFVKeys::mul_inplace(Ciphertext & ct, const Plaintext & pt)
 {
-    eval->multiply_plain_inplace(ct, pt);
+    if ( pt.is_zero() ) ct = zeroLike(ct);
+    else if ( !pt.is_ntt_form() ) impl->eval->multiply_plain_inplace( ct, pt, scratch() );
+    else
+    {
+        // a prepared plaintext is already in NTT form, only the ciphertext moves
+        impl->eval->transform_to_ntt_inplace(ct);
+        impl->eval->multiply_plain_inplace( ct, pt, scratch() );
+        impl->eval->transform_from_ntt_inplace(ct);
+    }
 }
 
 void SealBFVKeys::mul_inplace(Ciphertext & ct, int s)
 {
-    if (!s) ct = zero;
-    else eval->multiply_plain_inplace( ct, encode(s) );
+    if (!s) ct = zeroLike(ct);
+    else impl->eval->multiply_plain_inplace( ct, encode(s), scratch() );
 }
 
 void SealBFVKeys::mul_inplace(Ciphertext & ct, uint64_t s)
 {
-    if (!s) ct = zero;
-    else eval->multiply_plain_inplace( ct, encode(s) );
+    if (!s) ct = zeroLike(ct);
+    else impl->eval->multiply_plain_inplace( ct, encode(s), scratch() );
 }
 
 Ciphertext SealBFVKeys::mul_many(const vector<Ciphertext> & vct)
 {
     Ciphertext cto;
-    eval->multiply_many(vct, rk, cto);
+    impl->eval->multiply_many( vct, relinKeys(), cto, scratch() );
     return cto;
 }
 
 Ciphertext SealBFVKeys::negate(const Ciphertext & ct)
 {
     Ciphertext cto;
-    eval->negate(ct, cto);
+    impl->eval->negate(ct, cto);
     return cto;
 }
 
 void SealBFVKeys::negate_inplace(Ciphertext & ct)
 {
-    eval->negate_inplace(ct);
+    impl->eval->negate_inplace(ct);
 }
 
 int SealBFVKeys::plaintextModulus() const
 {
-    return t;
+    return impl->t;
 }
 
 int SealBFVKeys::polynomialDegree() const
 {
-    return n;
+    return impl->n;
 }
 
 int SealBFVKeys::reduce(int & s)
 {
+    int t = impl->t;
     s %= t;
     if (s < 0) s += t;
     return s;
@@ -368,7 +676,7 @@ int SealBFVKeys::reduce(int & s)
 
 void SealBFVKeys::relinearize_inplace(Ciphertext & ct)
 {
-    eval->relinearize_inplace(ct, rk);
+    impl->eval->relinearize_inplace( ct, relinKeys(), scratch() );
 }
 
 Ciphertext SealBFVKeys::rescale_mod_switch_to(Ciphertext & ct1, const Ciphertext & ct2)
@@ -376,49 +684,59 @@ Ciphertext SealBFVKeys::rescale_mod_switch_to(Ciphertext & ct1, const Ciphertext
     if ( ct1.coeff_modulus_size() < ct2.coeff_modulus_size() )
     {
         Ciphertext cto;
-        if ( ct2.is_ntt_form() ) eval->mod_switch_to( ct2, ct1.parms_id(), cto );
-        else eval->rescale_to( ct2, ct1.parms_id(), cto );
+        if ( ct2.is_ntt_form() ) impl->eval->mod_switch_to( ct2, ct1.parms_id(), cto );
+        else impl->eval->rescale_to( ct2, ct1.parms_id(), cto );
         return cto;
     }
 
     if ( ct1.coeff_modulus_size() > ct2.coeff_modulus_size() )
     {
-        if ( ct1.is_ntt_form() ) eval->mod_switch_to_inplace( ct1, ct2.parms_id() );
-        else eval->rescale_to_inplace( ct1, ct2.parms_id() );
+        if ( ct1.is_ntt_form() ) impl->eval->mod_switch_to_inplace( ct1, ct2.parms_id() );
+        else impl->eval->rescale_to_inplace( ct1, ct2.parms_id() );
     }
     return ct2;
 }
 
 void SealBFVKeys::rescale_mod_switch_to_next_inplace(seal::Ciphertext & ct)
 {
-    if ( ct.is_ntt_form() ) eval->mod_switch_to_next_inplace(ct);
-    else eval->rescale_to_next_inplace(ct);
+    if ( ct.is_ntt_form() ) impl->eval->mod_switch_to_next_inplace(ct);
+    else impl->eval->rescale_to_next_inplace(ct);
 }
 
 Ciphertext SealBFVKeys::rotate_columns(const Ciphertext & ct)
 {
     Ciphertext cto;
-    eval->rotate_columns(ct, gk, cto);
+    impl->eval->rotate_columns( ct, galoisKeys(0), cto, scratch() );
     return cto;
 }
 
 void SealBFVKeys::rotate_columns_inplace(Ciphertext & ct)
 {
-    eval->rotate_columns_inplace(ct, gk);
+    impl->eval->rotate_columns_inplace( ct, galoisKeys(0), scratch() );
 }
 
 Ciphertext SealBFVKeys::rotate_rows(const Ciphertext & ct, int & s)
 {
-    s %= (n >> 1);
+    int step = rowStep(s);
+    if (!step) return ct; // step 0 would fetch the keys of the columns
     Ciphertext cto;
-    eval->rotate_rows(ct, s, gk, cto);
+    impl->eval->rotate_rows( ct, step, galoisKeys(step), cto, scratch() );
     return cto;
 }
 
 void SealBFVKeys::rotate_rows_inplace(Ciphertext & ct, int & s)
 {
-    s %= (n >> 1);
-    eval->rotate_rows_inplace(ct, s, gk);
+    int step = rowStep(s);
+    if (step) impl->eval->rotate_rows_inplace( ct, step, galoisKeys(step), scratch() );
+}
+
+// Reduces s to a row rotation and returns it as a left step: rotating right
+// by s is the same as rotating left by n/2 - s, so both share a Galois key.
+int SealBFVKeys::rowStep(int & s) const
+{
+    int half = impl->n >> 1;
+    s %= half;
+    return s < 0 ? s + half : s;
 }
 
 bool SealBFVKeys::saveKeys(const SealBFVKeys & keys, const string & filename)
@@ -430,65 +748,160 @@ bool SealBFVKeys::save(const string & filename) const
 {
     try
     {
+        loadGalois();
         // n, t
         {
             string fname = filename + ".cfg.key";
             ofstream fout(fname);
-            fout << n << '\n';
-            fout << t << '\n';
+            fout << impl->n << '\n';
+            fout << impl->t << '\n';
+            lock_guard<mutex> lock(impl->lazy_mutex);
+            fout << impl->has_gk << ' ' << impl->galois.size();
+            for (const auto & g : impl->galois) fout << ' ' << g.first;
+            fout << '\n';
         }
         // secret key
         {
             string fname = filename + ".sk.key";
             ofstream fout(fname);
-            sk.save(fout);
+            impl->sk.save(fout);
         }
         // public key
         {
             string fname = filename + ".pk.key";
             ofstream fout(fname);
-            pk.save(fout);
+            impl->pk.save(fout);
         }
         // relinearization keys
         {
             string fname = filename + ".rk.key";
             ofstream fout(fname);
-            rk.save(fout);
+            relinKeys().save(fout);
         }
         // Galois keys
         {
             string fname = filename + ".gk.key";
             ofstream fout(fname);
-            gk.save(fout);
+            lock_guard<mutex> lock(impl->lazy_mutex);
+            if (impl->has_gk) impl->gk.save(fout);
+            for (const auto & g : impl->galois) g.second.save(fout);
         }
     }
     catch (...) { return false; }
     return true;
 }
 
+// The instance that ciphertexts and plaintexts hold: copies of the same key
+// set map to one instance, whose address identifies the key context. Once
+// made, it is found through the key set without a lock; the mutex only keeps
+// two threads from making it at once.
+shared_ptr<SealBFVKeys> SealBFVKeys::share(const SealBFVKeys & keys)
+{
+    if ( keys.impl )
+    {
+        auto weak = atomic_load(&keys.impl->shared);
+        if ( auto p = weak ? weak->lock() : nullptr ) return p;
+    }
+
+    lock_guard<mutex> lock(shared_mutex);
+    if ( !keys.impl )
+    {
+        auto p = empty_keys.lock();
+        if (!p) empty_keys = p = make_shared<SealBFVKeys>(keys);
+        return p;
+    }
+    auto weak = atomic_load(&keys.impl->shared);
+    if ( auto p = weak ? weak->lock() : nullptr ) return p;
+
+    auto p = make_shared<SealBFVKeys>(keys);
+    atomic_store( &keys.impl->shared, shared_ptr<const weak_ptr<SealBFVKeys>>( make_shared<weak_ptr<SealBFVKeys>>(p) ) );
+    return p;
+}
+
+// Writes the key set to a binary file for loadBinary. The file is written
+// under a temporary name and renamed, so readers never see it partial.
+bool SealBFVKeys::saveBinary(const string & filename) const
+{
+    string temporary = filename + "." + to_string( getpid() );
+    try
+    {
+        vector<FileSection> sections;
+        string data;
+        auto add = [&](int kind, int step, const auto & key)
+        {
+            ostringstream out;
+            key.save(out);
+            sections.push_back( FileSection{kind, step, data.size(), out.str().size()} );
+            data += out.str();
+        };
+        add(SK, 0, impl->sk);
+        add(PK, 0, impl->pk);
+        add(RK, 0, relinKeys());
+        loadGalois();
+        {
+            lock_guard<mutex> lock(impl->lazy_mutex);
+            if (impl->has_gk) add(GK_ALL, 0, impl->gk);
+            for (const auto & g : impl->galois) add(GK_STEP, g.first, g.second);
+        }
+
+        FileHeader header;
+        memcpy(header.magic, MAGIC, sizeof MAGIC);
+        header.n = impl->n;
+        header.t = impl->t;
+        header.count = sections.size();
+        size_t start = sizeof header + sections.size() * sizeof(FileSection);
+        for (auto & section : sections) section.offset += start;
+
+        {
+            ofstream fout(temporary, ios::binary);
+            fout.write( reinterpret_cast<const char *>(&header), sizeof header );
+            fout.write( reinterpret_cast<const char *>(sections.data()), sections.size() * sizeof(FileSection) );
+            fout.write( data.data(), data.size() );
+            if (!fout) throw "Cannot write " + temporary;
+        }
+        if ( rename(temporary.c_str(), filename.c_str()) ) throw "Cannot rename " + temporary;
+    }
+    catch (...)
+    {
+        remove( temporary.c_str() );
+        return false;
+    }
+    return true;
+}
+
+// Encrypts v with the secret key and writes it with the seed of its random
+// half in place of the half itself, which loading expands again: the output
+// is about half the size of a public-key ciphertext.
+void SealBFVKeys::saveSeeded(const vector<int> & v, ostream & out, bool compress)
+{
+    if (!impl->sym) throw "Seeded encryption requires the secret key";
+    impl->sym->encrypt_symmetric( encode(v) )
+        .save( out, compress ? Serialization::compr_mode_default : compr_mode_type::none );
+}
+
 Ciphertext SealBFVKeys::square(const Ciphertext & ct)
 {
     Ciphertext cto;
-    eval->square(ct, cto);
+    impl->eval->square( ct, cto, scratch() );
     return cto;
 }
 
 void SealBFVKeys::square_inplace(Ciphertext & ct)
 {
-    eval->square_inplace(ct);
+    impl->eval->square_inplace( ct, scratch() );
 }
 
 Ciphertext SealBFVKeys::sub(const Ciphertext & ct1, const Ciphertext & ct2)
 {
     Ciphertext cto;
-    eval->sub(ct1, ct2, cto);
+    impl->eval->sub(ct1, ct2, cto);
     return cto;
 }
 
 Ciphertext SealBFVKeys::sub(const Ciphertext & ct, const Plaintext & pt)
 {
     Ciphertext cto;
-    eval->sub_plain(ct, pt, cto);
+    impl->eval->sub_plain(ct, pt, cto);
     return cto;
 }
 
@@ -504,22 +917,27 @@ Ciphertext SealBFVKeys::sub(const Ciphertext & ct, uint64_t s)
 
 void SealBFVKeys::sub_inplace(Ciphertext & ct1, const Ciphertext & ct2)
 {
-    eval->sub_inplace(ct1, ct2);
+    impl->eval->sub_inplace(ct1, ct2);
 }
 
 void SealBFVKeys::sub_inplace(Ciphertext & ct, const Plaintext & pt)
 {
-    eval->sub_plain_inplace(ct, pt);
+    impl->eval->sub_plain_inplace(ct, pt);
 }
 
 void SealBFVKeys::sub_inplace(Ciphertext & ct, int s)
 {
-    eval->sub_plain_inplace( ct, encode(s) );
+    impl->eval->sub_plain_inplace( ct, encode(s) );
 }
 
 void SealBFVKeys::sub_inplace(Ciphertext & ct, uint64_t s)
 {
-    eval->sub_plain_inplace( ct, encode(s) );
+    impl->eval->sub_plain_inplace( ct, encode(s) );
+}
+
+void SealBFVKeys::transform_to_ntt_inplace(Plaintext & pt)
+{
+    impl->eval->transform_to_ntt_inplace(pt, impl->context->first_parms_id());
 }
 
 } // seal_wrapper
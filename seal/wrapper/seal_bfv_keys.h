@@ -1,42 +1,93 @@
 #pragma once
 
+#include <atomic>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include "seal/seal.h"
 
+#ifndef SEAL_POOL
+    #define SEAL_POOL 0
+#endif
+
+#ifndef KEY_STORE
+    #define KEY_STORE "" // directory of the binary key files ("": none)
+#endif
+
 namespace seal_wrapper
 {
 
+// A handle to a key set. The keys, the SEAL context and the objects built on
+// them are created once and never modified, so copies of a handle share them
+// and they can be used from many threads at once. Key sets with the same
+// parameters share one SEAL context. Relinearization and Galois keys are the
+// exception: they are made the first time they are used, either loaded from
+// the binary file the key set was opened from or generated from the secret
+// key. Galois keys are made per rotation step, unless the key set is created
+// for a declared list of steps or comes with a whole set.
 class SealBFVKeys
 {
     private:
-        int n; // polynomial modulus
-        int t; // plaintext modulus
-        seal::EncryptionParameters params;
-        std::shared_ptr<seal::SEALContext> context;
-        seal::SecretKey sk;
-        seal::PublicKey pk;
-        seal::RelinKeys rk;
-        seal::GaloisKeys gk;
-        seal::Encryptor * enc;
-        seal::Decryptor * dec;
-        seal::Evaluator * eval;
-        seal::BatchEncoder * encoder;
-        seal::Ciphertext zero;
+        struct Section
+        {
+            size_t offset;
+            size_t size;
+        };
+
+        struct Impl
+        {
+            int n; // polynomial modulus
+            int t; // plaintext modulus
+            std::shared_ptr<seal::SEALContext> context;
+            seal::SecretKey sk;
+            seal::PublicKey pk;
+            mutable std::mutex lazy_mutex; // guards the keys made on first use
+            mutable seal::RelinKeys rk;
+            mutable std::atomic<bool> has_rk{false};
+            mutable seal::GaloisKeys gk; // a whole set, given or loaded, if has_gk
+            mutable bool has_gk = false;
+            mutable std::map<int, seal::GaloisKeys> galois; // by step, 0 for columns
+            // the keys of each step once they exist, found without the lock
+            std::unique_ptr<std::atomic<const seal::GaloisKeys *>[]> galois_found;
+            const char * file = nullptr; // mapped binary key file, if any
+            size_t file_size = 0;
+            std::map<std::pair<int, int>, Section> sections; // by kind and step
+            std::unique_ptr<seal::Encryptor> enc;
+            std::unique_ptr<seal::Encryptor> sym; // with the secret key
+            std::unique_ptr<seal::Decryptor> dec;
+            std::unique_ptr<seal::Evaluator> eval;
+            std::unique_ptr<seal::BatchEncoder> encoder;
+            seal::Ciphertext zero;
+            // the instance given by share, read and replaced with the
+            // atomic shared_ptr functions so that finding it takes no lock
+            mutable std::shared_ptr<const std::weak_ptr<SealBFVKeys>> shared;
+
+            ~Impl();
+        };
+
+        std::shared_ptr<const Impl> impl;
+
+        const seal::GaloisKeys & galoisKeys(int step) const;
+        const seal::GaloisKeys & lockedGaloisKeys(int step) const;
+        const seal::RelinKeys & relinKeys() const;
+        void loadGalois() const;
+        int rowStep(int & s) const;
+        seal::Ciphertext zeroLike(const seal::Ciphertext &) const;
 
-        void createContext();
+        static std::shared_ptr<seal::SEALContext> createContext(int n, int t);
+        static std::shared_ptr<const Impl> finish(std::unique_ptr<Impl>, bool encrypt, bool decrypt);
+        template <class Key> static bool loadSection(const Impl &, Key &, int kind, int step = 0);
 
     public:
         SealBFVKeys() {}
         SealBFVKeys(int n, int t);
+        SealBFVKeys(int n, int t, const std::vector<int> & steps);
         SealBFVKeys(int n, int t, const seal::SecretKey &,
             const seal::PublicKey &, const seal::RelinKeys &,
             const seal::GaloisKeys &);
-        SealBFVKeys(const SealBFVKeys &);
-        ~SealBFVKeys();
 
-        SealBFVKeys & operator =(const SealBFVKeys &);
         seal::Ciphertext add(const seal::Ciphertext &, const seal::Ciphertext &);
         seal::Ciphertext add(const seal::Ciphertext &, const seal::Plaintext &);
         seal::Ciphertext add(const seal::Ciphertext &, int);
@@ -58,8 +109,10 @@ class SealBFVKeys
         seal::Ciphertext encrypt(uint64_t);
         seal::Ciphertext encrypt(const std::vector<int> &);
         seal::Ciphertext encrypt(const std::vector<uint64_t> &);
-        void generate(int n, int t);
+        void generate(int n, int t, const std::vector<int> & steps = {});
         bool load(const std::string & filename);
+        bool loadBinary(const std::string & filename);
+        seal::Ciphertext loadCiphertext(std::istream &) const;
         seal::Ciphertext mod_switch_to_next(const seal::Ciphertext &);
         void mod_switch_to_next_inplace(seal::Ciphertext &);
         seal::Ciphertext mul(const seal::Ciphertext &, const seal::Ciphertext &);
@@ -84,6 +137,8 @@ class SealBFVKeys
         seal::Ciphertext rotate_rows(const seal::Ciphertext &, int &);
         void rotate_rows_inplace(seal::Ciphertext &, int &);
         bool save(const std::string & filename) const;
+        bool saveBinary(const std::string & filename) const;
+        void saveSeeded(const std::vector<int> &, std::ostream &, bool compress);
         seal::Ciphertext square(const seal::Ciphertext &);
         void square_inplace(seal::Ciphertext &);
         seal::Ciphertext sub(const seal::Ciphertext &, const seal::Ciphertext &);
@@ -94,9 +149,12 @@ class SealBFVKeys
         void sub_inplace(seal::Ciphertext &, const seal::Plaintext &);
         void sub_inplace(seal::Ciphertext &, int);
         void sub_inplace(seal::Ciphertext &, uint64_t);
+        void transform_to_ntt_inplace(seal::Plaintext &);
 
         static SealBFVKeys loadKeys(const std::string & filename);
+        static SealBFVKeys openKeys(int n, int t, const std::string & dir = KEY_STORE);
         static bool saveKeys(const SealBFVKeys &, const std::string &);
+        static std::shared_ptr<SealBFVKeys> share(const SealBFVKeys &);
 };
 
 } // seal_wrapper
@@ -10,16 +10,16 @@ namespace seal_wrapper
 shared_ptr<SealBFVKeys> SealBFVPlaintext::default_keys;
 
 SealBFVPlaintext::SealBFVPlaintext(int s)
-    : SealBFVPlaintext(s, *default_keys) {}
+    : SealBFVPlaintext(s, default_keys) {}
 
 SealBFVPlaintext::SealBFVPlaintext(uint64_t s)
-    : SealBFVPlaintext(s, *default_keys) {}
+    : SealBFVPlaintext(s, default_keys) {}
 
 SealBFVPlaintext::SealBFVPlaintext(const std::vector<int> & v)
-    : SealBFVPlaintext(v, *default_keys) {}
+    : SealBFVPlaintext(v, default_keys) {}
 
 SealBFVPlaintext::SealBFVPlaintext(const std::vector<uint64_t> & v)
-    : SealBFVPlaintext(v, *default_keys) {}
+    : SealBFVPlaintext(v, default_keys) {}
 
 SealBFVPlaintext::SealBFVPlaintext(const SealBFVPlaintext & pt)
 {
@@ -29,25 +29,53 @@ SealBFVPlaintext::SealBFVPlaintext(const SealBFVPlaintext & pt)
 
 SealBFVPlaintext::SealBFVPlaintext(int s, const SealBFVKeys & keys)
 {
-    this->keys = make_shared<SealBFVKeys>(keys);
+    this->keys = SealBFVKeys::share(keys);
+    pt = this->keys->encode(s);
+}
+
+SealBFVPlaintext::SealBFVPlaintext(int s, const std::shared_ptr<SealBFVKeys> & keys)
+{
+    if (!keys) throw "Invalid SealBFVKeys";
+    this->keys = keys;
     pt = this->keys->encode(s);
 }
 
 SealBFVPlaintext::SealBFVPlaintext(uint64_t s, const SealBFVKeys & keys)
 {
-    this->keys = make_shared<SealBFVKeys>(keys);
+    this->keys = SealBFVKeys::share(keys);
+    pt = this->keys->encode(s);
+}
+
+SealBFVPlaintext::SealBFVPlaintext(uint64_t s, const std::shared_ptr<SealBFVKeys> & keys)
+{
+    if (!keys) throw "Invalid SealBFVKeys";
+    this->keys = keys;
     pt = this->keys->encode(s);
 }
 
 SealBFVPlaintext::SealBFVPlaintext(const std::vector<int> & s, const SealBFVKeys & keys)
 {
-    this->keys = make_shared<SealBFVKeys>(keys);
+    this->keys = SealBFVKeys::share(keys);
+    pt = this->keys->encode(s);
+}
+
+SealBFVPlaintext::SealBFVPlaintext(const std::vector<int> & s, const std::shared_ptr<SealBFVKeys> & keys)
+{
+    if (!keys) throw "Invalid SealBFVKeys";
+    this->keys = keys;
     pt = this->keys->encode(s);
 }
 
 SealBFVPlaintext::SealBFVPlaintext(const std::vector<uint64_t> & s, const SealBFVKeys & keys)
 {
-    this->keys = make_shared<SealBFVKeys>(keys);
+    this->keys = SealBFVKeys::share(keys);
+    pt = this->keys->encode(s);
+}
+
+SealBFVPlaintext::SealBFVPlaintext(const std::vector<uint64_t> & s, const std::shared_ptr<SealBFVKeys> & keys)
+{
+    if (!keys) throw "Invalid SealBFVKeys";
+    this->keys = keys;
     pt = this->keys->encode(s);
 }
 
@@ -84,6 +112,11 @@ vector<int> SealBFVPlaintext::decode_int() const
     return vi;
 }
 
+bool SealBFVPlaintext::isPrepared() const
+{
+    return pt.is_ntt_form();
+}
+
 int SealBFVPlaintext::plaintextModulus() const
 {
     return keys->plaintextModulus();
@@ -94,9 +127,19 @@ int SealBFVPlaintext::polynomialDegree() const
     return keys->polynomialDegree();
 }
 
+// Moves the plaintext to NTT form once, so every multiplication by it skips
+// that transform. Scalars are left alone: SEAL already multiplies by a
+// constant plaintext without any transform. A prepared plaintext can only
+// be multiplied; it cannot be added, subtracted or decoded.
+SealBFVPlaintext & SealBFVPlaintext::prepare()
+{
+    if ( pt.coeff_count() > 1 && !pt.is_ntt_form() ) keys->transform_to_ntt_inplace(pt);
+    return *this;
+}
+
 SealBFVKeys SealBFVPlaintext::defaultKeys(const SealBFVKeys & keys)
 {
-    default_keys = make_shared<SealBFVKeys>(keys);
+    default_keys = SealBFVKeys::share(keys);
     return *default_keys;
 }
 
@@ -27,9 +27,13 @@ class SealBFVPlaintext
         SealBFVPlaintext(const std::vector<uint64_t> &);
         SealBFVPlaintext(const SealBFVPlaintext &);
         SealBFVPlaintext(int, const SealBFVKeys &);
+        SealBFVPlaintext(int, const std::shared_ptr<SealBFVKeys> &);
         SealBFVPlaintext(uint64_t, const SealBFVKeys &);
+        SealBFVPlaintext(uint64_t, const std::shared_ptr<SealBFVKeys> &);
         SealBFVPlaintext(const std::vector<int> &, const SealBFVKeys &);
+        SealBFVPlaintext(const std::vector<int> &, const std::shared_ptr<SealBFVKeys> &);
         SealBFVPlaintext(const std::vector<uint64_t> &, const SealBFVKeys &);
+        SealBFVPlaintext(const std::vector<uint64_t> &, const std::shared_ptr<SealBFVKeys> &);
 
         explicit operator int();
         explicit operator uint64_t();
@@ -38,8 +42,10 @@ class SealBFVPlaintext
 
         std::vector<uint64_t> decode() const;
         std::vector<int> decode_int() const;
+        bool isPrepared() const;
         int plaintextModulus() const;
         int polynomialDegree() const;
+        SealBFVPlaintext & prepare(); // NTT form, for multiplication only
 
         static SealBFVKeys defaultKeys(const SealBFVKeys & keys = *default_keys);
 };
@@ -0,0 +1,130 @@
+#include "seal_bfv_tensor.h"
+
+#include <cstring>
+
+using namespace std;
+
+namespace seal_wrapper
+{
+
+// Layout: the magic, the rank, the dimensions, then count + 1 offsets where
+// offset i is the start of ciphertext i and the last one the end of the
+// file. All integers are 64 bits but the rank.
+static const char MAGIC[8] = {'F', 'U', 'R', 'B', 'O', 'T', 'N', 'S'};
+
+SealBFVTensorWriter::SealBFVTensorWriter(const string & filename, const vector<size_t> & shape, bool compress)
+    : out(filename, ios::binary), filename(filename), count(1), compress(compress)
+{
+    if (!out) throw "Cannot open " + filename;
+    for (auto d : shape) count *= d;
+
+    uint32_t rank = shape.size(), padding = 0;
+    out.write(MAGIC, sizeof MAGIC);
+    out.write( reinterpret_cast<const char *>(&rank), sizeof rank );
+    out.write( reinterpret_cast<const char *>(&padding), sizeof padding );
+    for (uint64_t d : shape) out.write( reinterpret_cast<const char *>(&d), sizeof d );
+    table = out.tellp();
+
+    // zeros until close, so an unfinished file is refused by readers
+    vector<uint64_t> zeros(count + 1, 0);
+    out.write( reinterpret_cast<const char *>(zeros.data()), zeros.size() * sizeof(uint64_t) );
+    offsets.reserve(count + 1);
+}
+
+SealBFVTensorWriter::~SealBFVTensorWriter()
+{
+    try { close(); }
+    catch (...) {}
+}
+
+void SealBFVTensorWriter::close()
+{
+    if ( !out.is_open() ) return;
+    if ( offsets.size() != count )
+    {
+        out.close();
+        throw filename + ": " + to_string( offsets.size() ) + " of " + to_string(count) + " ciphertexts written";
+    }
+    offsets.push_back( out.tellp() );
+    out.seekp(table);
+    out.write( reinterpret_cast<const char *>(offsets.data()), offsets.size() * sizeof(uint64_t) );
+    out.close();
+    if (!out) throw "Cannot write " + filename;
+}
+
+void SealBFVTensorWriter::start()
+{
+    if ( !out.is_open() ) throw filename + " is closed";
+    if ( offsets.size() == count ) throw filename + " has its " + to_string(count) + " ciphertexts";
+    offsets.push_back( out.tellp() );
+}
+
+void SealBFVTensorWriter::write(const SealBFVCiphertext & ct)
+{
+    start();
+    ct.save(out, compress);
+}
+
+void SealBFVTensorWriter::write(const vector<int> & values, SealBFVKeys & keys)
+{
+    start();
+    keys.saveSeeded(values, out, compress);
+}
+
+SealBFVTensorReader::SealBFVTensorReader(const string & filename, const vector<shared_ptr<SealBFVKeys>> & keys)
+    : in(filename, ios::binary), keys(keys)
+{
+    if (!in) throw "Cannot open " + filename;
+    if ( keys.empty() ) throw "Reading " + filename + " requires keys";
+
+    in.seekg(0, ios::end);
+    uint64_t size = in.tellg();
+    in.seekg(0);
+
+    char magic[sizeof MAGIC];
+    uint32_t rank, padding;
+    in.read(magic, sizeof magic);
+    in.read( reinterpret_cast<char *>(&rank), sizeof rank );
+    in.read( reinterpret_cast<char *>(&padding), sizeof padding );
+    if ( !in || memcmp(magic, MAGIC, sizeof MAGIC) ) throw filename + " is not a tensor file";
+
+    // the dimensions and the offsets are bounded by the file, so a corrupt
+    // header is refused before anything is allocated for it
+    uint64_t header = sizeof magic + sizeof rank + sizeof padding;
+    if ( rank > (size - header) / sizeof(uint64_t) ) throw filename + " is incomplete";
+    header += uint64_t(rank) * sizeof(uint64_t);
+    uint64_t count = 1, limit = (size - header) / sizeof(uint64_t);
+    for (uint32_t i = 0; i < rank; i++)
+    {
+        uint64_t d = 0;
+        in.read( reinterpret_cast<char *>(&d), sizeof d );
+        if (!in) throw filename + " is incomplete";
+        shape.push_back(d);
+        if ( d && count > limit / d ) throw filename + " is incomplete";
+        count *= d;
+    }
+    if ( count >= limit ) throw filename + " is incomplete";
+    offsets.resize(count + 1);
+    in.read( reinterpret_cast<char *>(offsets.data()), offsets.size() * sizeof(uint64_t) );
+
+    uint64_t start = in.tellg();
+    for (size_t i = 0; i <= count; i++)
+        if ( !in || offsets[i] < (i ? offsets[i-1] : start) || offsets[i] > size ) throw filename + " is incomplete";
+}
+
+SealBFVCiphertext SealBFVTensorReader::next()
+{
+    return read(position++);
+}
+
+SealBFVCiphertext SealBFVTensorReader::read(size_t index)
+{
+    if ( index >= size() ) throw "Ciphertext " + to_string(index) + " is out of the tensor";
+    in.clear();
+    in.seekg(offsets[index]);
+    auto ct = SealBFVCiphertext::load( in, keys[index % keys.size()] );
+    if ( !in ) throw "Cannot read ciphertext " + to_string(index);
+    return ct;
+}
+
+} // seal_wrapper
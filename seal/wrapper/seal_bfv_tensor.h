@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "seal_bfv_ciphertext.h"
+#include "seal_bfv_keys.h"
+
+namespace seal_wrapper
+{
+
+// File of an encrypted tensor: the shape, the offset of every ciphertext and
+// the ciphertexts in row-major order, as SEAL serializes them. Writers and
+// readers hold one ciphertext at a time, so tensors larger than memory can
+// be produced by clients and consumed a slice at a time.
+
+// Appends the ciphertexts in order; close fills in their offsets.
+class SealBFVTensorWriter
+{
+    private:
+        std::ofstream out;
+        std::string filename;
+        std::streampos table; // where the offsets go
+        std::vector<uint64_t> offsets;
+        size_t count;
+        bool compress;
+
+        void start();
+
+    public:
+        SealBFVTensorWriter(const std::string & filename, const std::vector<size_t> & shape, bool compress = true);
+        ~SealBFVTensorWriter();
+
+        void close();
+        void write(const SealBFVCiphertext &);
+        void write(const std::vector<int> &, SealBFVKeys &); // seeded, with the secret key
+};
+
+// Reads the ciphertexts in order or by index. Ciphertext i is loaded with
+// keys[i % keys.size()], so CRT residues laid out in the innermost dimension
+// each get the keys of their coprime.
+class SealBFVTensorReader
+{
+    private:
+        std::ifstream in;
+        std::vector<size_t> shape;
+        std::vector<uint64_t> offsets;
+        std::vector<std::shared_ptr<SealBFVKeys>> keys;
+        size_t position = 0;
+
+    public:
+        SealBFVTensorReader(const std::string & filename, const std::vector<std::shared_ptr<SealBFVKeys>> & keys);
+
+        bool done() const { return position >= size(); }
+        const std::vector<size_t> & getShape() const { return shape; }
+        SealBFVCiphertext next();
+        SealBFVCiphertext read(size_t index);
+        size_t size() const { return offsets.size() - 1; }
+};
+
+// whole tensors of ciphertexts, or of types that convert to and from them
+template <class T> void loadTensor(const std::string & filename, std::vector<T> &,
+    const std::vector<std::shared_ptr<SealBFVKeys>> & keys);
+template <class T> void saveTensor(const std::string & filename, const std::vector<T> &, bool compress = true);
+
+} // seal_wrapper
+
+#include "seal_bfv_tensor.hpp"
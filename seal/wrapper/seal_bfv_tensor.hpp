@@ -0,0 +1,76 @@
+#pragma once
+
+#include <type_traits>
+
+namespace seal_wrapper
+{
+
+namespace detail
+{
+
+template <class T> struct IsVector : std::false_type {};
+template <class T> struct IsVector<std::vector<T>> : std::true_type {};
+
+template <class T>
+void tensorShape(const std::vector<T> & v, std::vector<size_t> & shape)
+{
+    shape.push_back( v.size() );
+    if constexpr ( IsVector<T>::value )
+    {
+        if ( v.empty() ) throw "Cannot infer the shape of an empty tensor";
+        tensorShape(v[0], shape);
+    }
+}
+
+template <class T>
+void tensorRead(SealBFVTensorReader & reader, std::vector<T> & v, size_t d)
+{
+    const auto & shape = reader.getShape();
+    if ( IsVector<T>::value == (d + 1 == shape.size()) )
+        throw "The tensor file has " + std::to_string( shape.size() ) + " dimensions";
+    v.clear();
+    v.reserve(shape[d]);
+    for ( size_t i=0; i<shape[d]; i++ )
+    {
+        if constexpr ( IsVector<T>::value )
+        {
+            v.emplace_back();
+            tensorRead(reader, v.back(), d + 1);
+        }
+        else v.push_back( T( reader.next() ) );
+    }
+}
+
+template <class T>
+void tensorWrite(SealBFVTensorWriter & writer, const std::vector<T> & v, const std::vector<size_t> & shape, size_t d)
+{
+    if ( v.size() != shape[d] ) throw "The tensor is not rectangular";
+    for ( const auto & e : v )
+    {
+        if constexpr ( IsVector<T>::value ) tensorWrite(writer, e, shape, d + 1);
+        else if constexpr ( std::is_same<T, SealBFVCiphertext>::value ) writer.write(e);
+        else writer.write( SealBFVCiphertext(e) );
+    }
+}
+
+} // detail
+
+template <class T>
+void loadTensor(const std::string & filename, std::vector<T> & tensor,
+    const std::vector<std::shared_ptr<SealBFVKeys>> & keys)
+{
+    SealBFVTensorReader reader(filename, keys);
+    detail::tensorRead(reader, tensor, 0);
+}
+
+template <class T>
+void saveTensor(const std::string & filename, const std::vector<T> & tensor, bool compress)
+{
+    std::vector<size_t> shape;
+    detail::tensorShape(tensor, shape);
+    SealBFVTensorWriter writer(filename, shape, compress);
+    detail::tensorWrite(writer, tensor, shape, 0);
+    writer.close();
+}
+
+} // seal_wrapper
@@ -1,43 +1,68 @@
 #pragma once
 
+#include <cstdint>
 #include <iostream>
+#include <tuple>
 #include <unordered_map>
+#include <utility>
 
 namespace smart
 {
 
-enum class Operator { ADD_CC=0, MUL_CC, SUB_CC, ADD_CP, MUL_CP, SUB_CP, SUB_PC };
+enum class Operator { ADD_CC=0, MUL_CC, SUB_CC, ADD_CP, MUL_CP, SUB_CP, SUB_PC,
+    ROT_ROWS, ROT_COLS, NEG, POW };
+const int N_OPERATORS = 11;
 
+// Key of an operation: the operator, the key context of the operands, the
+// first operand's id, and the second operand's id (_CC) or scalar (_CP, _PC,
+// the steps of ROT_ROWS and the exponent of POW; 0 for ROT_COLS and NEG).
+// Every field is kept whole, so distinct operations never share a key.
 class Entry
 {
     private:
-        size_t id;
+        int a;
+        int b;
+        int context;
+        Operator o;
 
     public:
-        Entry(int, int, Operator);
+        Entry() : Entry(0, 0, Operator::ADD_CC, 0) {}
+        Entry(int, int, Operator, int context);
+        int getContext() const { return context; }
+        int getScalar() const { return b; } // of the operators with one ciphertext
+        Operator op() const { return o; }
         bool operator <(const Entry &) const;
         bool operator ==(const Entry &) const;
 
         friend struct std::hash<Entry>;
 };
 
-inline Entry::Entry(int a, int b, Operator o)
+// the operands of commutative operators are sorted, so a+b hits b+a
+inline Entry::Entry(int a, int b, Operator o, int context)
+    : a(a), b(b), context(context), o(o)
 {
-    id = size_t(o);
-    id <<= 30;
-    id = a;
-    id <<= 30;
-    id |= b;
+    if ( (o == Operator::ADD_CC || o == Operator::MUL_CC) && b < a ) std::swap(this->a, this->b);
 }
 
-inline bool Entry::operator <(const Entry & b) const
+inline bool Entry::operator <(const Entry & e) const
 {
-    return id < b.id;
+    return std::tie(o, context, a, b) < std::tie(e.o, e.context, e.a, e.b);
 }
 
-inline bool Entry::operator ==(const Entry & b) const
+inline bool Entry::operator ==(const Entry & e) const
 {
-    return id == b.id;
+    return a == e.a && b == e.b && context == e.context && o == e.o;
+}
+
+// finalizer of splitmix64
+inline uint64_t mix(uint64_t h)
+{
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h;
 }
 
 } // smart
@@ -50,7 +75,9 @@ struct hash<smart::Entry>
 {
     inline size_t operator()(const smart::Entry & entry) const
     {
-        return entry.id;
+        uint64_t operands = uint64_t( uint32_t(entry.a) ) << 32 | uint32_t(entry.b);
+        uint64_t operation = uint64_t(entry.o) << 32 | uint32_t(entry.context);
+        return smart::mix( operands ^ smart::mix(operation) );
     }
 };
 
@@ -1,11 +1,17 @@
 #pragma once
 
-#if (LRU == 1)
-#pragma message "Using LRU cache"
-#else
-#pragma message "Using non-LRU cache"
-#endif
-
 #include "cache_notempl_wrapper.h"
 #include "cache_notempl_manager.h"
 #include "cache_notempl_cache.h"
+
+#if (POLICY == 0)
+#pragma message "Using FIFO cache"
+#elif (POLICY == 1)
+#pragma message "Using LRU cache"
+#elif (POLICY == 2)
+#pragma message "Using GreedyDual-Size cache"
+#elif (POLICY == 3)
+#pragma message "Using ARC cache"
+#else
+#error "POLICY must be 0 (FIFO), 1 (LRU), 2 (GDS) or 3 (ARC)"
+#endif
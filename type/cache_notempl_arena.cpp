@@ -0,0 +1,133 @@
+#include "cache_notempl_arena.h"
+
+#include <atomic>
+#include <mutex>
+#include <new>
+
+namespace smart
+{
+namespace arena
+{
+
+const size_t CLASS_BYTES = 64; // size classes are multiples of this
+const size_t N_CLASSES = 16;   // larger requests go to the heap
+const size_t CHUNK_BLOCKS = 64; // blocks carved at once
+const size_t MAX_LOCAL = 4 * CHUNK_BLOCKS; // free blocks a thread keeps
+
+struct Block
+{
+    Block * next;
+};
+
+struct FreeLists
+{
+    Block * first[N_CLASSES] = {};
+    size_t size[N_CLASSES] = {};
+};
+
+static std::atomic<size_t> nallocations{0};
+static std::atomic<size_t> nlive{0};
+static std::atomic<size_t> nreserved{0};
+
+// blocks given back by threads that exited or kept too many
+static std::mutex mutex;
+static FreeLists shared;
+
+static void give(FreeLists & from, size_t c)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    while (from.first[c])
+    {
+        auto b = from.first[c];
+        from.first[c] = b->next;
+        b->next = shared.first[c];
+        shared.first[c] = b;
+        shared.size[c]++;
+    }
+    from.size[c] = 0;
+}
+
+// The lists are trivially destructible, so objects freed while the process
+// exits still find them; the thread's blocks are handed over beforehand.
+static thread_local FreeLists local;
+
+struct Handover
+{
+    ~Handover()
+    {
+        for (size_t c = 0; c < N_CLASSES; c++) give(local, c);
+    }
+};
+
+static thread_local Handover handover;
+
+// takes back up to a chunk of shared blocks, or carves a new chunk
+static void refill(size_t c)
+{
+    (void) &handover; // registers the handover of this thread
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for ( size_t i = 0; i < CHUNK_BLOCKS && shared.first[c]; i++ )
+        {
+            auto b = shared.first[c];
+            shared.first[c] = b->next;
+            shared.size[c]--;
+            b->next = local.first[c];
+            local.first[c] = b;
+            local.size[c]++;
+        }
+    }
+    if (local.first[c]) return;
+
+    size_t bytes = (c + 1) * CLASS_BYTES;
+    auto chunk = static_cast<char *>( ::operator new(bytes * CHUNK_BLOCKS) );
+    nreserved += bytes * CHUNK_BLOCKS;
+    for (size_t i = CHUNK_BLOCKS; i-- > 0; )
+    {
+        auto b = reinterpret_cast<Block *>(chunk + i * bytes);
+        b->next = local.first[c];
+        local.first[c] = b;
+    }
+    local.size[c] += CHUNK_BLOCKS;
+}
+
+void * allocate(size_t bytes)
+{
+    nallocations++;
+    nlive++;
+    size_t c = (bytes + CLASS_BYTES - 1) / CLASS_BYTES - 1;
+    if (bytes == 0 || c >= N_CLASSES)
+    {
+        nreserved += bytes;
+        return ::operator new(bytes);
+    }
+    if (!local.first[c]) refill(c);
+    auto b = local.first[c];
+    local.first[c] = b->next;
+    local.size[c]--;
+    return b;
+}
+
+void deallocate(void * p, size_t bytes)
+{
+    nlive--;
+    size_t c = (bytes + CLASS_BYTES - 1) / CLASS_BYTES - 1;
+    if (bytes == 0 || c >= N_CLASSES)
+    {
+        nreserved -= bytes;
+        ::operator delete(p);
+        return;
+    }
+    auto b = static_cast<Block *>(p);
+    b->next = local.first[c];
+    local.first[c] = b;
+    if (++local.size[c] > MAX_LOCAL) give(local, c);
+}
+
+Stats stats()
+{
+    return Stats{ nallocations, nlive, nreserved };
+}
+
+} // arena
+} // smart
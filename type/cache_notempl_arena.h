@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include "seal_bfv.h"
+
+using Native = seal_wrapper::SealBFVCiphertext;
+
+namespace smart
+{
+
+// Size-class pools for the shared ciphertext objects held by Manager. Each
+// thread keeps its own free lists, so a freed object is reused by the next
+// allocation of its size without taking a lock or calling the heap. Blocks
+// are carved from chunks that are kept for the life of the process.
+namespace arena
+{
+
+struct Stats
+{
+    size_t allocations; // requests served
+    size_t live;        // blocks in use
+    size_t reserved;    // bytes taken from the heap
+};
+
+void * allocate(size_t bytes);
+void deallocate(void *, size_t bytes);
+Stats stats();
+
+} // arena
+
+template <class T>
+class ArenaAllocator
+{
+    public:
+        using value_type = T;
+
+        ArenaAllocator() {}
+        template <class U> ArenaAllocator(const ArenaAllocator<U> &) {}
+
+        T * allocate(size_t n);
+        void deallocate(T *, size_t n);
+};
+
+template <class T, class U>
+bool operator ==(const ArenaAllocator<T> &, const ArenaAllocator<U> &) { return true; }
+
+template <class T, class U>
+bool operator !=(const ArenaAllocator<T> &, const ArenaAllocator<U> &) { return false; }
+
+// object and reference count in one pooled block
+template <class... Args>
+std::shared_ptr<Native> makeNative(Args &&...);
+
+} // smart
+
+#include "cache_notempl_arena.hpp"
@@ -0,0 +1,24 @@
+#pragma once
+
+namespace smart
+{
+
+template <class T>
+T * ArenaAllocator<T>::allocate(size_t n)
+{
+    return static_cast<T *>( arena::allocate( n * sizeof(T) ) );
+}
+
+template <class T>
+void ArenaAllocator<T>::deallocate(T * p, size_t n)
+{
+    arena::deallocate( p, n * sizeof(T) );
+}
+
+template <class... Args>
+std::shared_ptr<Native> makeNative(Args &&... args)
+{
+    return std::allocate_shared<Native>( ArenaAllocator<Native>(), std::forward<Args>(args)... );
+}
+
+} // smart
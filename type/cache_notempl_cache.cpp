@@ -1,71 +1,207 @@
 #include "cache_notempl_cache.h"
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
 #include <utility>
-
-#ifndef LRU
-    #define LRU 0
-#endif
+#include <unistd.h>
 
 namespace smart
 {
 
 std::hash<Entry> Cache::hash;
 
+// the size limit is split among the shards, so the total never exceeds it;
+// no limit stays no limit in every shard
+static size_t shardLimit(size_t size, size_t shard)
+{
+    if ( size == size_t(-1) ) return size;
+    return size / N_SHARDS + (shard < size % N_SHARDS);
+}
+
+Cache::Cache()
+{
+    for (auto & c : costs) c = 1;
+    setPolicy( PolicyType(POLICY) );
+}
+
+// inserts between two samples of the resident set size
+const size_t RSS_PERIOD = 64;
+
+// resident set size of the process, 0 where /proc is not available
+static size_t residentBytes()
+{
+    std::ifstream statm("/proc/self/statm");
+    size_t pages, resident;
+    if ( !(statm >> pages >> resident) ) return 0;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// SEAL keeps freed ciphertexts in its memory pool rather than returning them
+// to the system, so the resident size does not shrink after an eviction.
+// Each growth above the ceiling is therefore evicted once: later ciphertexts
+// reuse the pooled memory and the resident size stops growing.
+void Cache::checkRss()
+{
+    if ( rssLimit == size_t(-1) ) return;
+    auto period = ++ninserts;
+    if ( period % RSS_PERIOD ) return;
+    auto rss = residentBytes();
+    auto mark = std::max( rssLimit, rssMark.load() );
+    if ( rss <= mark ) return;
+    rssMark = rss;
+    size_t excess = rss - mark, freed = 0;
+    for ( size_t i = 0; i < N_SHARDS && freed < excess; i++ )
+    {
+        auto & s = shards[ (period / RSS_PERIOD + i) % N_SHARDS ];
+        WriteLock lock(s.mutex);
+        freed += evict(s, excess - freed);
+    }
+}
+
 void Cache::clear()
 {
-    cache.clear();
+    for (auto & s : shards)
+    {
+        WriteLock lock(s.mutex);
+        s.cache.forEach([&](const Node & node){ nbytes -= node.bytes; });
+        s.cache.clear();
+        s.policy->clear();
+    }
+    spill.clear();
 }
 
 bool Cache::get(const Entry & entry, Wrapper & returnValue)
 {
     nrequests++;
-    auto it = cache.find(entry);
-    if ( it == cache.end() )
+    auto & s = shard(entry);
+    {
+        // a hit updates the policy's bookkeeping, except for FIFO
+        bool fifo = policyType == PolicyType::Fifo;
+        ReadLock read(s.mutex, std::defer_lock);
+        WriteLock write(s.mutex, std::defer_lock);
+        if (fifo) read.lock();
+        else write.lock();
+
+        auto node = s.cache.find(entry);
+        if (node)
+        {
+            returnValue = node->value;
+            if (!fifo) s.policy->hit(*node);
+            nhits++;
+            return true;
+        }
+    }
+    auto native = spill.take(entry);
+    if (native)
     {
-        nmisses++;
-        return false; // not in the cache
+        nhits++;
+        returnValue = Wrapper( native, contextOf(entry.getContext()) );
+        insert(entry, returnValue); // promoted back to memory
+        return true;
     }
+    nmisses++;
+    return false; // not in the cache
+}
 
-    auto & node = it->second;
-    returnValue = node.value;
-#if (LRU==1)
-    if (node.prev) node.prev->next = node.next;
-    else first = node.next;
-    if (node.next) node.next->prev = node.prev;
-    last->next = &node;
-    node.next = nullptr;
-    node.prev = last;
-    last = &node;
-#endif
-    nhits++;
-    return true;
+// evicts node, keeping its ciphertext in the spill file if there is one
+void Cache::erase(Shard & s, Node & node)
+{
+    auto native = Wrapper::nativeOf(node.value.id);
+    if (native) spill.put(node.entry, *native);
+    nbytes -= node.bytes;
+    s.policy->evict(node);
+    s.cache.erase(node.entry);
+}
+
+size_t Cache::evict(Shard & s, size_t bytes)
+{
+    size_t freed = 0;
+    for ( Node * v; freed < bytes && (v = s.policy->victim()); )
+    {
+        freed += v->bytes;
+        erase(s, *v);
+    }
+    return freed;
 }
 
 void Cache::insert(const Entry & entry, const Wrapper & value)
 {
-    auto it = cache.emplace(
-        std::pair<Entry,Node>{
-            entry,
-            Node{entry, value, last, nullptr}
-        }
-    ).first; // insert node into the cache and return an iterator
-    auto & node = it->second;
-    if (last) last->next = &node;
-    last = &node;
-    if (!first) first = &node;
-    resize(sizeLimit);
+    auto bytes = value.byteSize(); // outside the lock, it reads the manager
+    {
+        auto & s = shard(entry);
+        WriteLock lock(s.mutex);
+        auto ins = s.cache.emplace( entry, value, bytes, costs[int( entry.op() )] );
+        if (!ins.second) return; // another thread computed the same entry first
+        s.policy->insert(*ins.first);
+        nbytes += bytes;
+        resize( s, shardLimit(sizeLimit, &s - shards) );
+    }
+    checkRss();
 }
 
 void Cache::resize(size_t size)
 {
-    while ( cache.size() > size )
+    for (auto & s : shards)
+    {
+        WriteLock lock(s.mutex);
+        resize( s, shardLimit(size, &s - shards) );
+    }
+}
+
+// The entry limit is split among the shards. The byte limit is checked
+// against the total, evicting from the shard at hand: a shard's share of
+// it could be smaller than a single ciphertext.
+void Cache::resize(Shard & s, size_t size)
+{
+    while ( s.cache.size() > size || ( nbytes > byteLimit && !s.cache.empty() ) )
+        erase( s, *s.policy->victim() );
+}
+
+void Cache::setByteLimit(size_t bytes)
+{
+    byteLimit = bytes;
+    resize(sizeLimit);
+}
+
+void Cache::setCost(Operator o, double cost)
+{
+    costs[int(o)] = cost;
+    measured[int(o)] = true;
+}
+
+// replaces the policy of every shard; the cached entries are dropped
+void Cache::setPolicy(PolicyType type)
+{
+    policyType = type;
+    for (auto & s : shards)
+    {
+        WriteLock lock(s.mutex);
+        s.cache.forEach([&](const Node & node){ nbytes -= node.bytes; });
+        s.cache.clear();
+        s.policy = Policy::make( type, shardLimit(sizeLimit, &s - shards) );
+    }
+}
+
+void Cache::setRssLimit(size_t bytes)
+{
+    rssLimit = bytes;
+}
+
+void Cache::setSpillLimit(size_t bytes)
+{
+    spill.resize(bytes);
+}
+
+size_t Cache::size() const
+{
+    size_t n = 0;
+    for (auto & s : shards)
     {
-        auto f = first;
-        first->next->prev = nullptr;
-        first = first->next;
-        cache.erase(f->entry);
+        ReadLock lock(s.mutex);
+        n += s.cache.size();
     }
+    return n;
 }
 
 } // smart
@@ -1,48 +1,83 @@
 #pragma once
 
-#include <unordered_map>
+#include <atomic>
+#include <memory>
 #include "cache_entry.h"
+#include "cache_notempl_lock.h"
+#include "cache_notempl_policy.h"
+#include "cache_notempl_spill.h"
+#include "cache_notempl_table.h"
 #include "cache_notempl_wrapper.h"
 
 #ifndef MAX_CACHE_SIZE
     #define MAX_CACHE_SIZE -1
 #endif
 
-namespace smart
-{
+#ifndef MAX_CACHE_BYTES
+    #define MAX_CACHE_BYTES -1
+#endif
 
-class Wrapper;
+#ifndef MAX_RSS
+    #define MAX_RSS -1
+#endif
 
-struct Node
+namespace smart
 {
-    Entry entry;
-    Wrapper value;
-    Node * prev;
-    Node * next;
-};
 
 class Cache
 {
     private:
+        struct Shard
+        {
+            mutable Mutex mutex;
+            FlatTable cache;
+            std::unique_ptr<Policy> policy;
+        };
+
         static std::hash<Entry> hash;
-        std::unordered_map<Entry, Node>  cache;
-        Node * first = nullptr;
-        Node * last  = nullptr;
+        Shard shards[N_SHARDS];
         size_t sizeLimit = MAX_CACHE_SIZE;
+        size_t byteLimit = MAX_CACHE_BYTES;
+        size_t rssLimit  = MAX_RSS;
+        PolicyType policyType;
+        double costs[N_OPERATORS];
+        std::atomic<bool> measured[N_OPERATORS] = {};
+        Spill spill;
 
-        int nhits = 0;
-        int nmisses = 0;
-        int nrequests = 0;
+        std::atomic<int> nhits{0};
+        std::atomic<int> nmisses{0};
+        std::atomic<int> nrequests{0};
+        std::atomic<size_t> nbytes{0};
+        std::atomic<size_t> ninserts{0};
+        std::atomic<size_t> rssMark{0}; // resident size at the last eviction
+
+        Shard & shard(const Entry & entry) { return shards[shardOf( hash(entry) )]; }
+        void checkRss();
+        void erase(Shard &, Node &);
+        size_t evict(Shard &, size_t bytes);
+        void resize(Shard &, size_t);
 
     public:
+        Cache();
+
+        size_t bytes() const { return nbytes; }
         void clear();
         bool get(const Entry &, Wrapper &);
         int getHits() const { return nhits; }
         int getMisses() const { return nmisses; }
         int getRequests() const { return nrequests; }
+        int getSpillHits() const { return spill.getHits(); }
+        PolicyType getPolicy() const { return policyType; }
+        bool hasCost(Operator o) const { return measured[int(o)]; }
         void insert(const Entry &, const Wrapper &);
         void resize(size_t=MAX_CACHE_SIZE);
-        size_t size() const { return cache.size(); }
+        void setByteLimit(size_t=MAX_CACHE_BYTES);
+        void setCost(Operator, double);
+        void setPolicy(PolicyType);
+        void setRssLimit(size_t=MAX_RSS);
+        void setSpillLimit(size_t=MAX_SPILL_BYTES);
+        size_t size() const;
+        size_t spilled() const { return spill.size(); }
 };
 
 } // smart
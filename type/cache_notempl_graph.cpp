@@ -0,0 +1,182 @@
+#include "cache_notempl_graph.h"
+#include "cache_notempl_manager.h"
+
+#include <algorithm>
+
+namespace smart
+{
+
+// computes a pending result whose operands, or terms of a sum, are computed
+void Graph::compute(int id, Node & node, const std::vector<int> & terms)
+{
+    auto a = Wrapper::nativeOf(node.a.id);
+    int s = node.entry.getScalar();
+    std::shared_ptr<Native> r;
+    switch ( node.entry.op() )
+    {
+        case Operator::ADD_CC:
+        {
+            std::vector<std::shared_ptr<Native>> natives;
+            std::vector<const Native *> operands;
+            for (auto t : terms)
+            {
+                natives.push_back( Wrapper::nativeOf(t) );
+                operands.push_back( natives.back().get() );
+            }
+            r = makeNative( Native::add_many(operands) );
+            break;
+        }
+        case Operator::MUL_CC: r = makeNative( *a * *Wrapper::nativeOf(node.b.id) ); break;
+        case Operator::SUB_CC: r = makeNative( *a - *Wrapper::nativeOf(node.b.id) ); break;
+        case Operator::ADD_CP: r = makeNative(*a + s); break;
+        case Operator::MUL_CP: r = makeNative(*a * s); break;
+        case Operator::SUB_CP: r = makeNative(*a - s); break;
+        case Operator::SUB_PC: r = makeNative(s - *a); break;
+        case Operator::ROT_ROWS: r = makeNative(*a); *r <<= s; break;
+        case Operator::ROT_COLS: r = makeNative(!*a); break;
+        case Operator::NEG: r = makeNative(*a); ~*r; break;
+        case Operator::POW: r = makeNative(*a); *r ^= s; break;
+    }
+    auto op = node.entry.op();
+    if ( op == Operator::MUL_CC || op == Operator::POW || op == Operator::ROT_ROWS || op == Operator::ROT_COLS )
+        Wrapper::calibrateOnUse(*a, op, s);
+    if (node.relinearize) r->relinearize();
+    Wrapper::managerOf(id).attach(id, r);
+}
+
+// Computes id after the pending results it depends on, without recursion:
+// sums can be thousands of terms deep.
+void Graph::evaluate(int id)
+{
+    std::vector<int> stack{id}, t;
+    while ( !stack.empty() )
+    {
+        auto it = pending.find( stack.back() );
+        if ( it == pending.end() )
+        {
+            stack.pop_back();
+            continue;
+        }
+        auto & node = it->second;
+        t.clear();
+        terms(node, t);
+        bool ready = true;
+        for (auto x : t)
+            if ( pending.count(x) )
+            {
+                stack.push_back(x);
+                ready = false;
+            }
+        if (!ready) continue;
+
+        compute(it->first, node, t);
+        stack.pop_back();
+
+        // the partial sums folded into this one are no longer needed
+        std::vector<int> folded{it->first};
+        for (size_t i = 0; i < folded.size(); i++)
+        {
+            auto f = pending.find(folded[i]);
+            if ( f == pending.end() ) continue;
+            if ( f->second.entry.op() == Operator::ADD_CC )
+                for ( auto x : { f->second.a.id, f->second.b.id } )
+                    if ( std::find(t.begin(), t.end(), x) == t.end() ) folded.push_back(x);
+            pending.erase(f);
+        }
+    }
+}
+
+bool Graph::isPending(int id) const
+{
+    ReadLock lock(mutex);
+    return pending.count(id);
+}
+
+void Graph::materialize(int id)
+{
+    WriteLock lock(mutex);
+    if ( pending.count(id) ) evaluate(id);
+}
+
+Wrapper Graph::record(const Entry & entry, const Wrapper & a, const Wrapper & b)
+{
+    WriteLock lock(mutex);
+    auto it = values.find(entry);
+    if ( it != values.end() )
+    {
+        Wrapper hit(it->second);
+        if ( pending.count(hit.id) || Wrapper::nativeOf(hit.id) ) return hit;
+        values.erase(it); // the result is gone
+    }
+
+    Wrapper ret( std::shared_ptr<Native>(nullptr), contextOf( entry.getContext() ) );
+    pending.emplace( ret.id, Node{entry, a, b} );
+    values[entry] = ret.id;
+    if ( pending.size() + values.size() > sweepMark ) sweep();
+    return ret;
+}
+
+// a pending result is relinearized once computed
+bool Graph::relinearize(int id)
+{
+    WriteLock lock(mutex);
+    auto it = pending.find(id);
+    if ( it == pending.end() ) return false;
+    it->second.relinearize = true;
+    return true;
+}
+
+size_t Graph::size() const
+{
+    ReadLock lock(mutex);
+    return pending.size();
+}
+
+// Drops the pending results that nobody references, which releases their
+// operands in turn, and forgets the operations whose results are gone.
+void Graph::sweep()
+{
+    for (bool dropped = true; dropped; )
+    {
+        dropped = false;
+        for (auto it = pending.begin(); it != pending.end(); )
+            if ( Wrapper::nrefs(it->first) <= 0 )
+            {
+                it = pending.erase(it);
+                dropped = true;
+            }
+            else ++it;
+    }
+    for (auto it = values.begin(); it != values.end(); )
+        if ( Wrapper::nrefs(it->second) <= 0 ) it = values.erase(it);
+        else ++it;
+    sweepMark = std::max<size_t>( 2 * (pending.size() + values.size()), 1024 );
+}
+
+// The ciphertexts that node adds up: a sum of sums is flattened through the
+// partial sums that are still pending and referenced by this sum alone.
+void Graph::terms(const Node & node, std::vector<int> & t) const
+{
+    if ( node.entry.op() != Operator::ADD_CC )
+    {
+        t.push_back(node.a.id);
+        if (node.b.id) t.push_back(node.b.id);
+        return;
+    }
+    std::vector<const Node *> stack{&node};
+    while ( !stack.empty() )
+    {
+        auto n = stack.back();
+        stack.pop_back();
+        for ( auto x : { n->a.id, n->b.id } )
+        {
+            auto it = pending.find(x);
+            if ( it != pending.end() && it->second.entry.op() == Operator::ADD_CC
+                && Wrapper::nrefs(x) == 1 )
+                stack.push_back(&it->second);
+            else t.push_back(x);
+        }
+    }
+}
+
+} // smart
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include "cache_entry.h"
+#include "cache_notempl_lock.h"
+#include "cache_notempl_wrapper.h"
+
+namespace smart
+{
+
+// Operations recorded by the deferred mode (DEFER=1). A recorded result gets
+// an id without a ciphertext; it is computed, along with the operations it
+// depends on, when its ciphertext is needed. Until then:
+//  - an operation already recorded on the same operands returns the same id,
+//    which also holds for results that were computed and are still alive;
+//  - results that lose their last reference are dropped without being
+//    computed;
+//  - sums whose partial results are used nowhere else are added in one pass.
+class Graph
+{
+    private:
+        struct Node
+        {
+            Entry entry;
+            Wrapper a;
+            Wrapper b; // the second ciphertext, if any
+            bool relinearize = false;
+        };
+
+        mutable Mutex mutex;
+        std::unordered_map<int, Node> pending; // by the id of the result
+        std::unordered_map<Entry, int> values; // ids of the recorded operations
+        size_t sweepMark = 1024;
+
+        void compute(int id, Node &, const std::vector<int> & terms);
+        void evaluate(int id);
+        void sweep();
+        void terms(const Node &, std::vector<int> &) const;
+
+    public:
+        bool isPending(int id) const;
+        void materialize(int id);
+        Wrapper record(const Entry &, const Wrapper & a, const Wrapper & b = Wrapper());
+        bool relinearize(int id);
+        size_t size() const;
+};
+
+} // smart
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <mutex>
+#include <shared_mutex>
+
+#ifndef CONCURRENT
+    #define CONCURRENT 0
+#endif
+
+namespace smart
+{
+
+#if (CONCURRENT == 1)
+
+// number of independent stripes in Manager and Cache
+const int N_SHARDS = 64;
+using Mutex = std::shared_mutex;
+
+#else
+
+// single-threaded builds keep one stripe and pay nothing for locking
+const int N_SHARDS = 1;
+
+struct Mutex
+{
+    void lock() {}
+    void unlock() {}
+    void lock_shared() {}
+    void unlock_shared() {}
+};
+
+#endif
+
+using ReadLock  = std::shared_lock<Mutex>;
+using WriteLock = std::unique_lock<Mutex>;
+
+inline size_t shardOf(size_t h)
+{
+    h ^= h >> 31;
+    h *= 0x9e3779b97f4a7c15ull;
+    return (h >> 32) % N_SHARDS;
+}
+
+} // smart
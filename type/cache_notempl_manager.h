@@ -1,7 +1,10 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
-#include <unordered_map>
+#include <vector>
+#include "cache_notempl_lock.h"
 #include "seal_bfv.h"
 
 using Native = seal_wrapper::SealBFVCiphertext;
@@ -9,65 +12,182 @@ using Native = seal_wrapper::SealBFVCiphertext;
 namespace smart
 {
 
+// An id holds the index of its key context in its top bits and a number local
+// to the context in the others. The local number 0 is the zero of the
+// context; context 0 has the default-constructed wrappers only.
+const int CONTEXT_BITS = 4;
+const int N_CONTEXTS = 1 << CONTEXT_BITS;
+const int LOCAL_BITS = 31 - CONTEXT_BITS; // ids stay positive
+const int LOCAL_MASK = (1 << LOCAL_BITS) - 1;
+
+inline int contextOf(int id) { return uint32_t(id) >> LOCAL_BITS & (N_CONTEXTS - 1); }
+inline int zeroOf(int context) { return context << LOCAL_BITS; }
+
+// Ciphertexts and reference counts of one key context in a dense array
+// indexed by local id. Ids come from a counter, so they fill the array in
+// order; the array is split into pages that are allocated on first use and
+// never move.
 class Manager
 {
     private:
-        struct Value
+        struct Slot
         {
-            int ref;
-            std::shared_ptr<Native> native;
+            std::atomic<int> ref{0};
+            std::shared_ptr<Native> native; // guarded by the id's stripe
         };
-        std::unordered_map<int,Value> container;
-        int counter = 0;
+
+        static const int PAGE_BITS = 14;
+        static const size_t PAGE_SIZE = size_t(1) << PAGE_BITS;
+        static const size_t N_PAGES = (size_t(1) << LOCAL_BITS) / PAGE_SIZE;
+
+        std::atomic<Slot *> pages[N_PAGES] = {};
+        Mutex mutexes[N_SHARDS];
+        std::atomic<int> counter{0};
+        int base = 0; // zero of the context
+
+        Mutex & mutex(int id) { return mutexes[shardOf(id)]; }
+        Slot * find(int id) const;
+        Slot & slot(int id);
+        void set(int id, const std::shared_ptr<Native> &);
 
     public:
+        static const int NONE = -1; // id of moved-from wrappers, never counted
+
+        Manager() {}
+        Manager(const Manager &) = delete;
+        ~Manager();
+
         const std::shared_ptr<Native> operator[](int);
 
-        void newEmpty();
+        void attach(int id, const std::shared_ptr<Native> &);
+        void bind(int context) { base = zeroOf(context); }
         int  newId(const std::shared_ptr<Native> &);
         int  newId(const std::shared_ptr<Native> &, int);
+        int  newIds(const std::vector<std::shared_ptr<Native>> &);
         int  nrefs(int id);
         void refUp(int id);
         void refDown(int id);
+        int  renew(int id);
+        void reset();
         int getCounter() const { return counter; }
 };
 
+inline Manager::~Manager()
+{
+    for (auto & page : pages) delete[] page.load();
+}
+
+// nullptr if the id's page was never touched
+inline Manager::Slot * Manager::find(int id) const
+{
+    auto i = uint32_t(id) & LOCAL_MASK;
+    auto page = pages[i >> PAGE_BITS].load(std::memory_order_acquire);
+    return page ? &page[i & (PAGE_SIZE - 1)] : nullptr;
+}
+
+inline Manager::Slot & Manager::slot(int id)
+{
+    auto i = uint32_t(id) & LOCAL_MASK;
+    auto & entry = pages[i >> PAGE_BITS];
+    auto page = entry.load(std::memory_order_acquire);
+    if (!page)
+    {
+        auto fresh = new Slot[PAGE_SIZE];
+        if ( entry.compare_exchange_strong(page, fresh, std::memory_order_acq_rel) ) page = fresh;
+        else delete[] fresh; // another thread allocated it first
+    }
+    return page[i & (PAGE_SIZE - 1)];
+}
+
+inline void Manager::set(int id, const std::shared_ptr<Native> & native)
+{
+    auto & s = slot(id);
+    WriteLock lock( mutex(id) );
+    s.ref = 1;
+    s.native = native;
+}
+
 inline const std::shared_ptr<Native> Manager::operator[](int aid)
 {
-    return container[aid].native;
+    auto s = find(aid);
+    if (!s) return nullptr;
+    ReadLock lock( mutex(aid) );
+    return s->native;
 }
 
-inline void Manager::newEmpty()
+// sets the ciphertext of an id whose references are already counted
+inline void Manager::attach(int id, const std::shared_ptr<Native> & native)
 {
-    container[0] = Value{ 1, nullptr };
+    auto & s = slot(id);
+    WriteLock lock( mutex(id) );
+    s.native = native;
 }
 
 inline int Manager::newId(const std::shared_ptr<Native> & native)
 {
-    container[++counter] = Value{ 1, native };
-    return counter;
+    int local = ++counter; // never blocks, ids are never reused
+    if (local > LOCAL_MASK) throw "Key context out of ciphertext ids";
+    set(base + local, native);
+    return base + local;
 }
 
 inline int Manager::newId(const std::shared_ptr<Native> & native, int id)
 {
-    container[id] = Value{ 1, native };
+    set(id, native);
     return id;
 }
 
+// Registers natives under consecutive ids, reserved with one increment of
+// the counter, and returns the first one.
+inline int Manager::newIds(const std::vector<std::shared_ptr<Native>> & natives)
+{
+    int first = counter.fetch_add( int(natives.size()) ) + 1;
+    if ( size_t(first - 1) + natives.size() > size_t(LOCAL_MASK) ) throw "Key context out of ciphertext ids";
+    first += base;
+    for (size_t i = 0; i < natives.size(); i++) set(first + int(i), natives[i]);
+    return first;
+}
+
 inline int Manager::nrefs(int id)
 {
-    return container[id].ref;
+    auto s = find(id);
+    return s ? s->ref.load() : 0;
 }
 
 inline void Manager::refUp(int id)
 {
-    container[id].ref++;
+    slot(id).ref++;
 }
 
 inline void Manager::refDown(int id)
 {
-    auto & ref = container[id].ref;
-    if (--ref == 0) container.erase(id);
+    if (id == NONE) return;
+    auto s = find(id);
+    if (!s) return;
+    int ref = s->ref;
+    do if (ref <= 0) return; // released already
+    while ( !s->ref.compare_exchange_weak(ref, ref - 1) );
+    if (ref > 1) return;
+
+    // the count reached zero; release unless someone revived the id meanwhile
+    WriteLock lock( mutex(id) );
+    if (s->ref <= 0) s->native = nullptr;
+}
+
+// Forgets every id, once none of them is referenced any more
+inline void Manager::reset()
+{
+    for (auto & page : pages) delete[] page.exchange(nullptr);
+    counter = 0;
+}
+
+// Moves the ciphertext of an id with a single reference to a fresh id, so the
+// OOM entries keyed by the old id stop matching once it is modified in place.
+inline int Manager::renew(int id)
+{
+    auto native = (*this)[id];
+    refDown(id);
+    return newId(native);
 }
 
 } // smart
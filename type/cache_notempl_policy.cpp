@@ -0,0 +1,155 @@
+#include "cache_notempl_policy.h"
+
+#include <algorithm>
+
+namespace smart
+{
+
+void NodeList::push(Node & node)
+{
+    node.prev = last;
+    node.next = nullptr;
+    if (last) last->next = &node;
+    else first = &node;
+    last = &node;
+    size++;
+}
+
+void NodeList::unlink(Node & node)
+{
+    if (node.prev) node.prev->next = node.next;
+    else first = node.next;
+    if (node.next) node.next->prev = node.prev;
+    else last = node.prev;
+    node.prev = node.next = nullptr;
+    size--;
+}
+
+std::unique_ptr<Policy> Policy::make(PolicyType type, size_t capacity)
+{
+    switch (type)
+    {
+        case PolicyType::Fifo : return std::make_unique<Fifo>();
+        case PolicyType::Lru : return std::make_unique<Lru>();
+        case PolicyType::GreedyDualSize : return std::make_unique<GreedyDualSize>();
+        case PolicyType::Arc : return std::make_unique<Arc>(capacity);
+    }
+    throw "Unknown cache policy";
+}
+
+void Lru::hit(Node & node)
+{
+    if (&node == nodes.last) return;
+    nodes.unlink(node);
+    nodes.push(node);
+}
+
+void GreedyDualSize::push(Node & node)
+{
+    node.priority = inflation + node.cost / std::max<size_t>(node.bytes, 1);
+    queue.emplace(node.priority, &node);
+}
+
+void GreedyDualSize::clear()
+{
+    queue.clear();
+    inflation = 0;
+}
+
+void GreedyDualSize::evict(Node & node)
+{
+    queue.erase({node.priority, &node});
+    inflation = node.priority;
+}
+
+void GreedyDualSize::hit(Node & node)
+{
+    queue.erase({node.priority, &node});
+    push(node);
+}
+
+Node * GreedyDualSize::victim()
+{
+    return queue.empty() ? nullptr : queue.begin()->second;
+}
+
+// The ghost lists are bounded by the resident nodes as well as by the entry
+// limit: when bytes or the resident size limit the table, it holds fewer
+// entries than its entry limit, which may be unlimited.
+size_t Arc::target() const
+{
+    return std::min<size_t>( capacity, std::max<size_t>(t1.size + t2.size, 1) );
+}
+
+void Arc::trim()
+{
+    auto c = target();
+    while ( !b1.empty() && t1.size + b1.size() > c )
+    {
+        ghosts.erase( b1.front() );
+        b1.pop_front();
+    }
+    while ( !b2.empty() && t1.size + t2.size + b1.size() + b2.size() > 2 * c )
+    {
+        ghosts.erase( b2.front() );
+        b2.pop_front();
+    }
+}
+
+void Arc::clear()
+{
+    t1 = t2 = NodeList();
+    b1.clear();
+    b2.clear();
+    ghosts.clear();
+    p = 0;
+}
+
+void Arc::evict(Node & node)
+{
+    auto & ghost = node.list == T1 ? b1 : b2;
+    (node.list == T1 ? t1 : t2).unlink(node);
+    ghost.push_back(node.entry);
+    ghosts[node.entry] = { node.list == T1 ? B1 : B2, std::prev( ghost.end() ) };
+    trim();
+}
+
+void Arc::hit(Node & node)
+{
+    (node.list == T1 ? t1 : t2).unlink(node);
+    node.list = T2;
+    t2.push(node);
+}
+
+void Arc::insert(Node & node)
+{
+    node.list = T1;
+    auto it = ghosts.find(node.entry);
+    if ( it != ghosts.end() )
+    {
+        // a recent victim is back: grow the list that would have kept it
+        double c = target();
+        if (it->second.first == B1)
+        {
+            p = std::min( c, p + std::max( double( b2.size() ) / b1.size(), 1.0 ) );
+            b1.erase(it->second.second);
+        }
+        else
+        {
+            p = std::max( 0.0, p - std::max( double( b1.size() ) / b2.size(), 1.0 ) );
+            b2.erase(it->second.second);
+        }
+        ghosts.erase(it);
+        node.list = T2;
+    }
+    (node.list == T1 ? t1 : t2).push(node);
+    trim();
+}
+
+Node * Arc::victim()
+{
+    if ( t1.size && ( t1.size > p || !t2.size ) ) return t1.first;
+    return t2.first;
+}
+
+} // smart
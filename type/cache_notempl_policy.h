@@ -0,0 +1,126 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include "cache_entry.h"
+#include "cache_notempl_wrapper.h"
+
+#ifndef LRU
+    #define LRU 0
+#endif
+
+#ifndef POLICY
+    #define POLICY LRU
+#endif
+
+namespace smart
+{
+
+enum class PolicyType { Fifo=0, Lru, GreedyDualSize, Arc };
+
+struct Node
+{
+    Entry entry;
+    Wrapper value;
+    size_t bytes; // of the ciphertext held by value
+    double cost;  // to recompute value, in microseconds
+
+    // bookkeeping of the eviction policy
+    Node * prev = nullptr;
+    Node * next = nullptr;
+    double priority = 0;
+    int list = 0;
+};
+
+// intrusive list of nodes, from the oldest (first) to the newest (last)
+struct NodeList
+{
+    Node * first = nullptr;
+    Node * last  = nullptr;
+    size_t size  = 0;
+
+    void push(Node &);
+    void unlink(Node &);
+};
+
+// Decides which node of a shard leaves the cache first. The cache holds the
+// shard's lock on every call.
+class Policy
+{
+    public:
+        virtual ~Policy() {}
+        virtual void clear() = 0;
+        virtual void evict(Node &) = 0; // node is about to leave the cache
+        virtual void hit(Node &) = 0;
+        virtual void insert(Node &) = 0;
+        virtual Node * victim() = 0; // nullptr when the shard is empty
+
+        static std::unique_ptr<Policy> make(PolicyType, size_t capacity);
+};
+
+class Fifo : public Policy
+{
+    protected:
+        NodeList nodes;
+
+    public:
+        void clear() override { nodes = NodeList(); }
+        void evict(Node & node) override { nodes.unlink(node); }
+        void hit(Node &) override {}
+        void insert(Node & node) override { nodes.push(node); }
+        Node * victim() override { return nodes.first; }
+};
+
+class Lru : public Fifo
+{
+    public:
+        void hit(Node &) override;
+};
+
+// GreedyDual-Size: evicts the lowest recompute cost per byte, aged by the
+// priority of the last victim so that stale expensive nodes also leave
+class GreedyDualSize : public Policy
+{
+    private:
+        std::set<std::pair<double, Node *>> queue;
+        double inflation = 0;
+
+        void push(Node &);
+
+    public:
+        void clear() override;
+        void evict(Node &) override;
+        void hit(Node &) override;
+        void insert(Node & node) override { push(node); }
+        Node * victim() override;
+};
+
+// Adaptive Replacement Cache: balances recency (t1) against frequency (t2),
+// steered by ghost entries of recent victims (b1, b2)
+class Arc : public Policy
+{
+    private:
+        enum { T1, T2, B1, B2 };
+
+        NodeList t1, t2;
+        std::list<Entry> b1, b2;
+        std::unordered_map<Entry, std::pair<int, std::list<Entry>::iterator>> ghosts;
+        size_t capacity;
+        double p = 0; // target size of t1
+
+        size_t target() const;
+        void trim();
+
+    public:
+        Arc(size_t capacity) : capacity(capacity) {}
+        void clear() override;
+        void evict(Node &) override;
+        void hit(Node &) override;
+        void insert(Node &) override;
+        Node * victim() override;
+};
+
+} // smart
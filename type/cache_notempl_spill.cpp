@@ -0,0 +1,132 @@
+#include "cache_notempl_spill.h"
+#include "cache_notempl_arena.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace smart
+{
+
+Spill::~Spill()
+{
+    close();
+}
+
+void Spill::clear()
+{
+    WriteLock lock(mutex);
+    index.clear();
+    log.clear();
+    head = 0;
+}
+
+void Spill::close()
+{
+    if (data) munmap(data, capacity);
+    if (fd >= 0) ::close(fd);
+    data = nullptr;
+    fd = -1;
+}
+
+// maps the file on the first spill; a failure disables the tier
+bool Spill::open()
+{
+    if (data) return true;
+    if (!capacity) return false;
+    auto dir = std::getenv("TMPDIR");
+    std::string path = std::string(dir && *dir ? dir : "/tmp") + "/furbo-spill-XXXXXX";
+    fd = mkstemp(&path[0]);
+    if (fd >= 0)
+    {
+        unlink( path.c_str() );
+        if ( ftruncate(fd, capacity) == 0 )
+        {
+            auto p = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) data = static_cast<char *>(p);
+        }
+    }
+    if (data) return true;
+    std::cout << "WARNING: Cannot map a spill file at '" + path + "'. Evicted ciphertexts will be dropped.\n";
+    close();
+    capacity = 0;
+    return false;
+}
+
+// forgets the oldest records that the range [offset, offset+size) overwrites
+void Spill::overwrite(size_t offset, size_t size)
+{
+    while ( !log.empty() )
+    {
+        auto & w = log.front();
+        if ( w.offset >= offset + size || w.offset + w.size <= offset ) break;
+        auto it = index.find(w.entry);
+        if ( it != index.end() && it->second.offset == w.offset ) index.erase(it);
+        log.pop_front();
+    }
+}
+
+void Spill::put(const Entry & entry, const Native & native)
+{
+    if (!capacity) return;
+    std::ostringstream out;
+    native.save(out, SPILL_COMPRESS);
+    auto bytes = out.str();
+    auto size = bytes.size();
+
+    WriteLock lock(mutex);
+    if ( !open() || size > capacity || index.count(entry) ) return;
+    if (head + size > capacity)
+    {
+        // the tail is too short: drop what is left there and start over
+        overwrite(head, capacity - head);
+        head = 0;
+    }
+    overwrite(head, size);
+    std::memcpy(data + head, bytes.data(), size);
+    index[entry] = Record{ head, size, native.getKeys() };
+    log.push_back( Written{ entry, head, size } );
+    head += size;
+}
+
+void Spill::resize(size_t bytes)
+{
+    WriteLock lock(mutex);
+    close();
+    index.clear();
+    log.clear();
+    head = 0;
+    capacity = bytes;
+}
+
+size_t Spill::size() const
+{
+    ReadLock lock(mutex);
+    return index.size();
+}
+
+// loads a spilled ciphertext, which leaves the spill file for the OOM table
+std::shared_ptr<Native> Spill::take(const Entry & entry)
+{
+    if (!capacity) return nullptr;
+    std::string bytes;
+    std::shared_ptr<seal_wrapper::SealBFVKeys> keys;
+    {
+        WriteLock lock(mutex);
+        auto it = index.find(entry);
+        if ( it == index.end() ) return nullptr;
+        bytes.assign(data + it->second.offset, it->second.size);
+        keys = it->second.keys;
+        index.erase(it);
+    }
+    nhits++;
+    std::istringstream in(bytes);
+    return makeNative( Native::load(in, keys) );
+}
+
+} // smart
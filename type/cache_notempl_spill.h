@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include "cache_entry.h"
+#include "cache_notempl_lock.h"
+#include "seal_bfv.h"
+
+#ifndef MAX_SPILL_BYTES
+    #define MAX_SPILL_BYTES 0
+#endif
+
+#ifndef SPILL_COMPRESS
+    #define SPILL_COMPRESS 0
+#endif
+
+using Native = seal_wrapper::SealBFVCiphertext;
+
+namespace smart
+{
+
+// Second tier of the OOM table. Evicted ciphertexts are serialized into a
+// memory-mapped file, and a later hit loads them back instead of computing
+// them again. The file is written as a ring: once it is full, the oldest
+// records are overwritten. It lives in $TMPDIR (or /tmp) and is unlinked on
+// creation, so nothing is left behind.
+class Spill
+{
+    private:
+        struct Record
+        {
+            size_t offset;
+            size_t size;
+            std::shared_ptr<seal_wrapper::SealBFVKeys> keys;
+        };
+        struct Written
+        {
+            Entry entry;
+            size_t offset;
+            size_t size;
+        };
+
+        mutable Mutex mutex;
+        std::atomic<size_t> capacity{0};
+        char * data = nullptr;
+        int fd = -1;
+        size_t head = 0; // where the next record is written
+        std::unordered_map<Entry, Record> index;
+        std::deque<Written> log; // records in writing order, maybe taken since
+        std::atomic<int> nhits{0};
+
+        void close();
+        bool open();
+        void overwrite(size_t offset, size_t size);
+
+    public:
+        Spill(size_t capacity = MAX_SPILL_BYTES) : capacity(capacity) {}
+        Spill(const Spill &) = delete;
+        ~Spill();
+
+        void clear();
+        int getHits() const { return nhits; }
+        void put(const Entry &, const Native &);
+        void resize(size_t capacity);
+        size_t size() const;
+        std::shared_ptr<Native> take(const Entry &);
+};
+
+} // smart
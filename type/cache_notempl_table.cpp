@@ -0,0 +1,117 @@
+#include "cache_notempl_table.h"
+
+#include <algorithm>
+
+namespace smart
+{
+
+const size_t NPOS = size_t(-1);
+
+Node * FlatTable::allocate()
+{
+    if (!spare)
+    {
+        blocks.emplace_back( new Node[BLOCK_SIZE] );
+        auto block = blocks.back().get();
+        for (size_t i = 0; i < BLOCK_SIZE; i++) release(&block[i]);
+    }
+    auto node = spare;
+    spare = node->next;
+    return node;
+}
+
+void FlatTable::clear()
+{
+    for (size_t i = 0; i < slots.size(); i++)
+        if ( !(ctrl[i] & EMPTY) ) release(slots[i]);
+    std::fill(ctrl.begin(), ctrl.end(), EMPTY);
+    count = tombstones = 0;
+}
+
+std::pair<Node *, bool> FlatTable::emplace(const Entry & entry, const Wrapper & value,
+    size_t bytes, double cost)
+{
+    auto found = locate(entry);
+    if (found != NPOS) return { slots[found], false };
+
+    // keep at most 7/8 of the slots in use, tombstones included
+    auto capacity = slots.size();
+    if ( (count + tombstones + 1) * 8 > capacity * 7 )
+        rehash( (count + 1) * 16 > capacity * 7 ? std::max<size_t>(capacity * 2, 16) : capacity );
+
+    auto node = allocate();
+    node->entry = entry;
+    node->value = value;
+    node->bytes = bytes;
+    node->cost = cost;
+    node->prev = node->next = nullptr;
+    node->priority = 0;
+    node->list = 0;
+
+    auto h = hash(entry);
+    auto mask = slots.size() - 1;
+    auto i = h & mask;
+    while ( !(ctrl[i] & EMPTY) ) i = (i + 1) & mask;
+    if (ctrl[i] == DELETED) tombstones--;
+    ctrl[i] = tag(h);
+    slots[i] = node;
+    count++;
+    return { node, true };
+}
+
+void FlatTable::erase(const Entry & entry)
+{
+    auto i = locate(entry);
+    if (i == NPOS) return;
+    release(slots[i]);
+    ctrl[i] = DELETED;
+    count--;
+    tombstones++;
+}
+
+Node * FlatTable::find(const Entry & entry) const
+{
+    auto i = locate(entry);
+    return i == NPOS ? nullptr : slots[i];
+}
+
+size_t FlatTable::locate(const Entry & entry) const
+{
+    if ( slots.empty() ) return NPOS;
+    auto h = hash(entry);
+    auto t = tag(h);
+    auto mask = slots.size() - 1;
+    for ( auto i = h & mask; ctrl[i] != EMPTY; i = (i + 1) & mask )
+        if ( ctrl[i] == t && slots[i]->entry == entry ) return i;
+    return NPOS;
+}
+
+// moves the nodes to a table of the given capacity, dropping the tombstones
+void FlatTable::rehash(size_t capacity)
+{
+    std::vector<uint8_t> oldCtrl(capacity, EMPTY);
+    std::vector<Node *> oldSlots(capacity, nullptr);
+    oldCtrl.swap(ctrl);
+    oldSlots.swap(slots);
+    tombstones = 0;
+
+    auto mask = capacity - 1;
+    for (size_t j = 0; j < oldSlots.size(); j++)
+    {
+        if (oldCtrl[j] & EMPTY) continue;
+        auto h = hash(oldSlots[j]->entry);
+        auto i = h & mask;
+        while (ctrl[i] != EMPTY) i = (i + 1) & mask;
+        ctrl[i] = tag(h);
+        slots[i] = oldSlots[j];
+    }
+}
+
+void FlatTable::release(Node * node)
+{
+    node->value = Wrapper(); // drops the reference to the ciphertext
+    node->next = spare;
+    spare = node;
+}
+
+} // smart
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "cache_entry.h"
+#include "cache_notempl_policy.h"
+
+namespace smart
+{
+
+// Open-addressing hash table from Entry to Node. A byte of control per slot
+// holds the top 7 bits of the hash, so most probes never touch a node. Nodes
+// come from blocks that never move, which keeps the policies' links valid
+// across rehashes, and freed nodes are reused instead of returned to the heap.
+class FlatTable
+{
+    private:
+        static const uint8_t EMPTY   = 0x80;
+        static const uint8_t DELETED = 0xfe;
+        static const size_t BLOCK_SIZE = 256; // nodes per allocation
+
+        std::vector<uint8_t> ctrl; // EMPTY, DELETED or the tag of the node
+        std::vector<Node *> slots;
+        std::vector<std::unique_ptr<Node[]>> blocks;
+        Node * spare = nullptr; // free nodes, chained through next
+        size_t count = 0;
+        size_t tombstones = 0;
+
+        static size_t hash(const Entry & entry) { return std::hash<Entry>()(entry); }
+        static uint8_t tag(size_t h) { return h >> 57; }
+        Node * allocate();
+        size_t locate(const Entry &) const;
+        void rehash(size_t capacity);
+        void release(Node *);
+
+    public:
+        void clear();
+        bool empty() const { return count == 0; }
+        std::pair<Node *, bool> emplace(const Entry &, const Wrapper &, size_t bytes, double cost);
+        void erase(const Entry &);
+        Node * find(const Entry &) const;
+        template <class F> void forEach(F) const;
+        size_t size() const { return count; }
+};
+
+template <class F>
+void FlatTable::forEach(F f) const
+{
+    for (size_t i = 0; i < slots.size(); i++)
+        if ( !(ctrl[i] & EMPTY) ) f(*slots[i]);
+}
+
+} // smart
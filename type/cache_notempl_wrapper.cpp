@@ -1,41 +1,28 @@
 #include "cache_notempl_wrapper.h"
 #include "cache_notempl_manager.h"
 #include "cache_notempl_cache.h"
+#include "cache_notempl_graph.h"
+#include "parallel.h"
 
-#ifndef CTADD
-    #define CTADD 1
-#endif
-
-#ifndef CTMUL
-    #define CTMUL 0
-#endif
-
-#ifndef CTSUB
-    #define CTSUB 0
-#endif
-
-#ifndef PTADD
-    #define PTADD 0
-#endif
-
-#ifndef PTMUL
-    #define PTMUL 1
-#endif
-
-#ifndef PTSUB
-    #define PTSUB 0
-#endif
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
 
 namespace smart
 {
 
-Manager Wrapper::manager;
-Cache Wrapper::cache;
+Manager Wrapper::managers[N_CONTEXTS];
+Cache Wrapper::caches[N_CONTEXTS];
+#if (DEFER == 1)
+Graph Wrapper::graph;
+#endif
 std::shared_ptr<Wrapper> Wrapper::p_zero;
 
 Wrapper & Wrapper::operator +=(const Wrapper & a)
 {
-    int kid = (uint64_t) manager[id]->getKeys().get();
+    int kid = context();
     if (id == kid)
     {
         *this = a;
@@ -43,23 +30,27 @@ Wrapper & Wrapper::operator +=(const Wrapper & a)
     }
     if (a.id == kid) return *this;
 
+#if (DEFER == 1)
+    return *this = graph.record(Entry(id, a.id, Operator::ADD_CC, kid), *this, a);
+#else
 #if (CTADD == 1)
-    Entry entry(id, a.id, Operator::ADD_CC);
-    if ( !cache.get(entry, *this) )
+    Entry entry(id, a.id, Operator::ADD_CC, kid);
+    if ( !cacheOf(id).get(entry, *this) )
 #endif
     {
-        if (manager.nrefs(id) == 1) *manager[id] += *manager[a.id];
-        else *this = *manager[id] + *manager[a.id];
+        if (nrefs(id) == 1) own() += *nativeOf(a.id);
+        else *this = *nativeOf(id) + *nativeOf(a.id);
 #if (CTADD == 1)
-        cache.insert(entry, *this);
+        cacheOf(id).insert(entry, *this);
 #endif
     }
     return *this;
+#endif
 }
 
 Wrapper & Wrapper::operator *=(const Wrapper & a)
 {
-    int kid = (uint64_t) manager[id]->getKeys().get();
+    int kid = context();
     if (id == kid) return *this;
     if (a.id == kid)
     {
@@ -67,60 +58,73 @@ Wrapper & Wrapper::operator *=(const Wrapper & a)
         return *this;
     }
 
+#if (DEFER == 1)
+    return *this = graph.record(Entry(id, a.id, Operator::MUL_CC, kid), *this, a);
+#else
 #if (CTMUL == 1)
-    Entry entry(id, a.id, Operator::MUL_CC);
-    if ( !cache.get(entry, *this) )
+    Entry entry(id, a.id, Operator::MUL_CC, kid);
+    if ( !cacheOf(id).get(entry, *this) )
 #endif
     {
-        if (manager.nrefs(id) == 1) *manager[id] *= *manager[a.id];
-        else *this = *manager[id] * *manager[a.id];
+        if (nrefs(id) == 1) own() *= *nativeOf(a.id);
+        else *this = *nativeOf(id) * *nativeOf(a.id);
 #if (CTMUL == 1)
-        cache.insert(entry, *this);
+        calibrateOnUse(*nativeOf(id), Operator::MUL_CC);
+        cacheOf(id).insert(entry, *this);
 #endif
     }
     return *this;
+#endif
 }
 
 Wrapper & Wrapper::operator -=(const Wrapper & a)
 {
-    int kid = (uint64_t) manager[id]->getKeys().get();
+    int kid = context();
     if (a.id == kid) return *this;
 
+#if (DEFER == 1)
+    return *this = graph.record(Entry(id, a.id, Operator::SUB_CC, kid), *this, a);
+#else
 #if (CTSUB == 1)
-    Entry entry(id, a.id, Operator::SUB_CC);
-    if ( !cache.get(entry, *this) )
+    Entry entry(id, a.id, Operator::SUB_CC, kid);
+    if ( !cacheOf(id).get(entry, *this) )
 #endif
     {
-        if (manager.nrefs(id) == 1) *manager[id] -= *manager[a.id];
-        else *this = *manager[id] - *manager[a.id];
+        if (nrefs(id) == 1) own() -= *nativeOf(a.id);
+        else *this = *nativeOf(id) - *nativeOf(a.id);
 #if (CTSUB == 1)
-        cache.insert(entry, *this);
+        cacheOf(id).insert(entry, *this);
 #endif
     }
     return *this;
+#endif
 }
 
 Wrapper & Wrapper::operator +=(int a)
 {
     if (!a) return *this;
 
+#if (DEFER == 1)
+    return *this = graph.record(Entry(id, a, Operator::ADD_CP, context()), *this);
+#else
 #if (PTADD == 1)
-    Entry entry(id, a, Operator::ADD_CP);
-    if ( !cache.get(entry, *this) )
+    Entry entry(id, a, Operator::ADD_CP, context());
+    if ( !cacheOf(id).get(entry, *this) )
 #endif
     {
-        if (manager.nrefs(id) == 1) *manager[id] += a;
-        else *this = *manager[id] + a;
+        if (nrefs(id) == 1) own() += a;
+        else *this = *nativeOf(id) + a;
 #if (PTADD == 1)
-        cache.insert(entry, *this);
+        cacheOf(id).insert(entry, *this);
 #endif
     }
     return *this;
+#endif
 }
 
 Wrapper & Wrapper::operator *=(int a)
 {
-    int kid = (uint64_t) manager[id]->getKeys().get();
+    int kid = context();
     if (id == kid) return *this;
     if (!a)
     {
@@ -129,155 +133,374 @@ Wrapper & Wrapper::operator *=(int a)
     }
     if (a == 1) return *this;
 
+#if (DEFER == 1)
+    return *this = graph.record(Entry(id, a, Operator::MUL_CP, kid), *this);
+#else
 #if (PTMUL == 1)
-    Entry entry(id, a, Operator::MUL_CP);
-    if ( !cache.get(entry, *this) )
+    Entry entry(id, a, Operator::MUL_CP, kid);
+    if ( !cacheOf(id).get(entry, *this) )
 #endif
     {
-        if (manager.nrefs(id) == 1) *manager[id] *= a;
-        else *this = *manager[id] * a;
+        if (nrefs(id) == 1) own() *= a;
+        else *this = *nativeOf(id) * a;
 #if (PTMUL == 1)
-        cache.insert(entry, *this);
+        cacheOf(id).insert(entry, *this);
 #endif
     }
     return *this;
+#endif
 }
 
 Wrapper & Wrapper::operator -=(int a)
 {
     if (!a) return *this;
 
+#if (DEFER == 1)
+    return *this = graph.record(Entry(id, a, Operator::SUB_CP, context()), *this);
+#else
 #if (PTSUB == 1)
-    Entry entry(id, a, Operator::SUB_CP);
-    if ( !cache.get(entry, *this) )
+    Entry entry(id, a, Operator::SUB_CP, context());
+    if ( !cacheOf(id).get(entry, *this) )
 #endif
     {
-        if (manager.nrefs(id) == 1) *manager[id] -= a;
-        else *this = *manager[id] - a;
+        if (nrefs(id) == 1) own() -= a;
+        else *this = *nativeOf(id) - a;
 #if (PTSUB == 1)
-        cache.insert(entry, *this);
+        cacheOf(id).insert(entry, *this);
 #endif
     }
     return *this;
+#endif
 }
 
-Wrapper Wrapper::operator +(const Wrapper & a) const
+Wrapper & Wrapper::operator ~()
 {
-    int kid = (uint64_t) manager[id]->getKeys().get(); // FIXME e set highest bit to 1
+    int kid = context();
+    if (id == kid) return *this;
+
+#if (DEFER == 1)
+    return *this = graph.record(Entry(id, 0, Operator::NEG, kid), *this);
+#else
+#if (CTNEG == 1)
+    Entry entry(id, 0, Operator::NEG, kid);
+    if ( !cacheOf(id).get(entry, *this) )
+#endif
+    {
+        ~own();
+#if (CTNEG == 1)
+        cacheOf(id).insert(entry, *this);
+#endif
+    }
+    return *this;
+#endif
+}
+
+Wrapper & Wrapper::operator ^=(int e)
+{
+    int kid = context();
+    if (e == 1 || (id == kid && e > 0)) return *this;
+
+#if (DEFER == 1)
+    return *this = graph.record(Entry(id, e, Operator::POW, kid), *this);
+#else
+#if (CTPOW == 1)
+    Entry entry(id, e, Operator::POW, kid);
+    if ( !cacheOf(id).get(entry, *this) )
+#endif
+    {
+        own() ^= e;
+#if (CTPOW == 1)
+        calibrateOnUse(*nativeOf(id), Operator::POW);
+        cacheOf(id).insert(entry, *this);
+#endif
+    }
+    return *this;
+#endif
+}
+
+// rotations in both directions share the entries, with s < 0 to the right
+Wrapper & Wrapper::operator <<=(int s)
+{
+    int kid = context();
+    if (!s || id == kid) return *this;
+
+#if (DEFER == 1)
+    return *this = graph.record(Entry(id, s, Operator::ROT_ROWS, kid), *this);
+#else
+#if (CTROT == 1)
+    Entry entry(id, s, Operator::ROT_ROWS, kid);
+    if ( !cacheOf(id).get(entry, *this) )
+#endif
+    {
+        own() <<= s;
+#if (CTROT == 1)
+        calibrateOnUse(*nativeOf(id), Operator::ROT_ROWS, s);
+        cacheOf(id).insert(entry, *this);
+#endif
+    }
+    return *this;
+#endif
+}
+
+Wrapper & Wrapper::operator >>=(int s)
+{
+    return *this <<= -s;
+}
+
+Wrapper Wrapper::operator +(const Wrapper & a) const &
+{
+    int kid = context(); // FIXME e set highest bit to 1
     if (id == kid) return a;
     if (a.id == kid) return *this;
 
+#if (DEFER == 1)
+    return graph.record(Entry(id, a.id, Operator::ADD_CC, kid), *this, a);
+#else
     Wrapper ret;
 #if (CTADD == 1)
-    Entry entry(id, a.id, Operator::ADD_CC);
-    if ( !cache.get(entry, ret) )
+    Entry entry(id, a.id, Operator::ADD_CC, kid);
+    if ( !cacheOf(id).get(entry, ret) )
 #endif
     {
-        ret = *manager[id] + *manager[a.id];
+        ret = *nativeOf(id) + *nativeOf(a.id);
 #if (CTADD == 1)
-        cache.insert(entry, ret);
+        cacheOf(id).insert(entry, ret);
 #endif
     }
     return ret;
+#endif
 }
 
-Wrapper Wrapper::operator *(const Wrapper & a) const
+Wrapper Wrapper::operator *(const Wrapper & a) const &
 {
-    int kid = (uint64_t) manager[id]->getKeys().get();
+    int kid = context();
     if (id == kid || a.id == kid) return Wrapper(kid);
 
+#if (DEFER == 1)
+    return graph.record(Entry(id, a.id, Operator::MUL_CC, kid), *this, a);
+#else
     Wrapper ret;
 #if (CTMUL == 1)
-    Entry entry(id, a.id, Operator::MUL_CC);
-    if ( !cache.get(entry, ret) )
+    Entry entry(id, a.id, Operator::MUL_CC, kid);
+    if ( !cacheOf(id).get(entry, ret) )
 #endif
     {
-        ret = *manager[id] * *manager[a.id];
+        ret = *nativeOf(id) * *nativeOf(a.id);
 #if (CTMUL == 1)
-        cache.insert(entry, ret);
+        calibrateOnUse(*nativeOf(id), Operator::MUL_CC);
+        cacheOf(id).insert(entry, ret);
 #endif
     }
     return ret;
+#endif
 }
 
-Wrapper Wrapper::operator -(const Wrapper & a) const
+Wrapper Wrapper::operator -(const Wrapper & a) const &
 {
-    int kid = (uint64_t) manager[id]->getKeys().get();
+    int kid = context();
     if (a.id == kid) return *this;
 
+#if (DEFER == 1)
+    return graph.record(Entry(id, a.id, Operator::SUB_CC, kid), *this, a);
+#else
     Wrapper ret;
 #if (CTSUB == 1)
-    Entry entry(id, a.id, Operator::SUB_CC);
-    if ( !cache.get(entry, ret) )
+    Entry entry(id, a.id, Operator::SUB_CC, kid);
+    if ( !cacheOf(id).get(entry, ret) )
 #endif
     {
-        ret = *manager[id] - *manager[a.id];
+        ret = *nativeOf(id) - *nativeOf(a.id);
 #if (CTSUB == 1)
-        cache.insert(entry, ret);
+        cacheOf(id).insert(entry, ret);
 #endif
     }
     return ret;
+#endif
 }
 
-Wrapper Wrapper::operator +(int a) const
+Wrapper Wrapper::operator +(int a) const &
 {
     if (!a) return *this;
 
+#if (DEFER == 1)
+    return graph.record(Entry(id, a, Operator::ADD_CP, context()), *this);
+#else
     Wrapper ret;
 #if (PTADD == 1)
-    Entry entry(id, a, Operator::ADD_CP);
-    if ( !cache.get(entry, ret) )
+    Entry entry(id, a, Operator::ADD_CP, context());
+    if ( !cacheOf(id).get(entry, ret) )
 #endif
     {
-        ret = *manager[id] + a;
+        ret = *nativeOf(id) + a;
 #if (PTADD == 1)
-        cache.insert(entry, ret);
+        cacheOf(id).insert(entry, ret);
 #endif
     }
     return ret;
+#endif
 }
 
-Wrapper Wrapper::operator *(int a) const
+Wrapper Wrapper::operator *(int a) const &
 {
-    int kid = (uint64_t) manager[id]->getKeys().get();
+    int kid = context();
     if (!a || id == kid) return Wrapper(kid);
     if (a == 1) return *this;
 
+#if (DEFER == 1)
+    return graph.record(Entry(id, a, Operator::MUL_CP, kid), *this);
+#else
     Wrapper ret;
 #if (PTMUL == 1)
-    Entry entry(id, a, Operator::MUL_CP);
-    if ( !cache.get(entry, ret) )
+    Entry entry(id, a, Operator::MUL_CP, kid);
+    if ( !cacheOf(id).get(entry, ret) )
 #endif
     {
-        ret = *manager[id] * a;
+        ret = *nativeOf(id) * a;
 #if (PTMUL == 1)
-        cache.insert(entry, ret);
+        cacheOf(id).insert(entry, ret);
 #endif
     }
     return ret;
+#endif
 }
 
-Wrapper Wrapper::operator -(int a) const
+Wrapper Wrapper::operator -(int a) const &
 {
     if (!a) return *this;
 
+#if (DEFER == 1)
+    return graph.record(Entry(id, a, Operator::SUB_CP, context()), *this);
+#else
     Wrapper ret;
 #if (PTSUB == 1)
-    Entry entry(id, a, Operator::SUB_CP);
-    if ( !cache.get(entry, ret) )
+    Entry entry(id, a, Operator::SUB_CP, context());
+    if ( !cacheOf(id).get(entry, ret) )
 #endif
     {
-        ret = *manager[id] - a;
+        ret = *nativeOf(id) - a;
 #if (PTSUB == 1)
-        cache.insert(entry, ret);
+        cacheOf(id).insert(entry, ret);
+#endif
+    }
+    return ret;
+#endif
+}
+
+Wrapper Wrapper::operator -() const &
+{
+    Wrapper ret(*this);
+    ~ret;
+    return ret;
+}
+
+Wrapper Wrapper::operator !() const
+{
+    int kid = context();
+    if (id == kid) return *this;
+
+#if (DEFER == 1)
+    return graph.record(Entry(id, 0, Operator::ROT_COLS, kid), *this);
+#else
+    Wrapper ret;
+#if (CTROT == 1)
+    Entry entry(id, 0, Operator::ROT_COLS, kid);
+    if ( !cacheOf(id).get(entry, ret) )
+#endif
+    {
+        ret = !*nativeOf(id);
+#if (CTROT == 1)
+        calibrateOnUse(*nativeOf(id), Operator::ROT_COLS);
+        cacheOf(id).insert(entry, ret);
 #endif
     }
     return ret;
+#endif
+}
+
+Wrapper Wrapper::operator ^(int e) const &
+{
+    Wrapper ret(*this);
+    ret ^= e;
+    return ret;
+}
+
+Wrapper Wrapper::operator <<(int s) const &
+{
+#if (DEFER == 1)
+    if (!s || id == context()) return *this;
+    return graph.record(Entry(id, s, Operator::ROT_ROWS, context()), *this);
+#else
+    Wrapper ret(*this);
+    ret <<= s;
+    return ret;
+#endif
+}
+
+Wrapper Wrapper::operator >>(int s) const &
+{
+    return *this << -s;
+}
+
+#if (CTADD == 0)
+// Sums the natives in one pass, creating a single id for the result instead
+// of one per pairwise add. When CT_ADD=1 the pairwise adds are kept, since
+// each of them is recorded in the OOM table.
+Wrapper Wrapper::add_many(const std::vector<const Wrapper *> & v)
+{
+#if (DEFER == 1)
+    // the recorded sum is added in one pass when computed
+    if ( v.empty() ) return *p_zero;
+    Wrapper sum = *v[0];
+    for (size_t i = 1; i < v.size(); i++) sum += *v[i];
+    return sum;
+#endif
+    std::vector<std::shared_ptr<Native>> natives;
+    std::vector<const Native *> operands;
+    const Wrapper * last = nullptr;
+    for (auto a : v)
+    {
+        if ( a->id == zeroOf(contextOf(a->id)) ) continue;
+        auto native = nativeOf(a->id);
+        natives.push_back(native);
+        operands.push_back( native.get() );
+        last = a;
+    }
+    if ( operands.empty() ) return v.empty() ? *p_zero : *v[0];
+    if ( operands.size() == 1 ) return *last;
+    return Native::add_many(operands);
+}
+#endif
+
+size_t Wrapper::byteSize() const
+{
+    auto native = nativeOf(id);
+    return native ? native->byteSize() : 0;
+}
+
+// The native of this wrapper, ready to be modified in place: a shared one is
+// copied first, and a sole one moves to a fresh id.
+Native & Wrapper::own()
+{
+    if (nrefs(id) > 1) *this = Wrapper( *nativeOf(id) );
+    else id = managerOf(id).renew(id);
+    return *nativeOf(id);
+}
+
+// id of the zero of the key context, which also identifies the context
+int Wrapper::context() const
+{
+    return zeroOf( contextOf(id) );
+}
+
+// OOM table of the key context of id
+Cache & Wrapper::cacheOf(int id)
+{
+    return caches[contextOf(id)];
 }
 
 void Wrapper::clearCache()
 {
-    cache.clear();
+    for (auto & cache : caches) cache.clear();
 }
 
 std::vector<int> Wrapper::getCounters()
@@ -285,20 +508,241 @@ std::vector<int> Wrapper::getCounters()
     return Native::getCounters();
 }
 
+Cache & Wrapper::getCache(int context)
+{
+    return caches[context];
+}
+
 int Wrapper::getId() const
 {
     return id;
 }
 
+// computes the ciphertext of a deferred result
+void Wrapper::materialize() const
+{
+#if (DEFER == 1)
+    graph.materialize(id);
+#endif
+}
+
+// a shared native is replaced by a relinearized copy rather than modified
+void Wrapper::relinearize()
+{
+#if (DEFER == 1)
+    if ( graph.relinearize(id) ) return;
+#endif
+    auto native = nativeOf(id);
+    if ( !native || !native->pendingRelinearization() ) return;
+    if (nrefs(id) == 1) native->relinearize();
+    else
+    {
+        Native r = *native;
+        r.relinearize();
+        *this = std::move(r);
+    }
+}
+
 void Wrapper::resizeCache(size_t size)
 {
-    cache.resize(size);
+    for (auto & cache : caches) cache.resize(size);
+}
+
+// Trims the OOM tables after a row of a convolution. They are shared by the
+// workers, so CACHE_RESIZE entries are kept for each band in progress. The
+// trim evicts in policy order, so the entries kept are the most recently
+// used, those of the rows under the filter windows of the bands in progress.
+void Wrapper::trimCache()
+{
+    size_t size = CACHE_RESIZE;
+    resizeCache( size == size_t(-1) ? size : size * parallel::threads() );
+}
+
+// best of three runs, in microseconds
+static double timeOf(const std::function<void()> & f)
+{
+    double best = -1;
+    for (int i = 0; i < 3; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double, std::micro> t = std::chrono::steady_clock::now() - start;
+        best = best < 0 ? t.count() : std::min(best, t.count());
+    }
+    return best;
+}
+
+// Stops counting the operations of this thread while in scope, so the timed
+// ones do not show up among those of the program; other threads still count
+struct Uncounted
+{
+    bool was = Native::setCounting(false);
+    ~Uncounted() { Native::setCounting(was); }
+};
+
+// Measures what recomputing each operator costs with the keys of sample, for
+// the OOM table of their context. Products of ciphertexts, powers and
+// rotations need keys of their own and are timed on first use instead, see
+// calibrateOnUse.
+void Wrapper::calibrateCache(const Native & sample)
+{
+    auto & cache = caches[keyContext(sample)];
+    Uncounted uncounted;
+    auto keys = sample.getKeys();
+    Native x(3, keys), y(5, keys), z;
+    cache.setCost( Operator::ADD_CC, timeOf([&]{ z = x + y; }) );
+    cache.setCost( Operator::SUB_CC, timeOf([&]{ z = x - y; }) );
+    cache.setCost( Operator::ADD_CP, timeOf([&]{ z = x + 3; }) );
+    cache.setCost( Operator::MUL_CP, timeOf([&]{ z = x * 3; }) );
+    cache.setCost( Operator::SUB_CP, timeOf([&]{ z = x - 3; }) );
+    cache.setCost( Operator::SUB_PC, timeOf([&]{ z = -x; z += 3; }) );
+    cache.setCost( Operator::NEG, timeOf([&]{ z = -x; }) );
+}
+
+// Times op on sample (s: its scalar) for GreedyDual-Size, once such an
+// operation has run: the relinearization or Galois keys it needs, made on
+// first use, then exist, and workloads that never use it make none.
+void Wrapper::calibrateOnUse(const Native & sample, Operator op, int s)
+{
+    auto & cache = caches[keyContext(sample)];
+    if ( cache.getPolicy() != PolicyType::GreedyDualSize || cache.hasCost(op) ) return;
+    Uncounted uncounted;
+    Native z;
+    switch (op)
+    {
+        case Operator::MUL_CC:
+        {
+            Native y = sample + 1; // another id, or the product is a square
+            cache.setCost( op, timeOf([&]{ z = sample * y; }) );
+            break;
+        }
+        case Operator::POW: cache.setCost( op, timeOf([&]{ z = sample; z ^= 2; }) ); break;
+        case Operator::ROT_ROWS: cache.setCost( op, timeOf([&]{ z = sample; z <<= s; }) ); break;
+        case Operator::ROT_COLS: cache.setCost( op, timeOf([&]{ z = !sample; }) ); break;
+        default: break;
+    }
 }
 
+void Wrapper::setCacheByteLimit(size_t bytes)
+{
+    for (auto & cache : caches) cache.setByteLimit(bytes);
+}
+
+void Wrapper::setCacheRssLimit(size_t bytes)
+{
+    for (auto & cache : caches) cache.setRssLimit(bytes);
+}
+
+void Wrapper::setCacheSpillLimit(size_t bytes)
+{
+    for (auto & cache : caches) cache.setSpillLimit(bytes);
+}
+
+void Wrapper::setCachePolicy(int policy)
+{
+    for (auto & cache : caches) cache.setPolicy( PolicyType(policy) );
+}
+
+// the zero returned by sums of no ciphertexts
 void Wrapper::setZero(const Native & zero)
 {
-    int kid = (uint64_t) zero.getKeys().get();
-    p_zero = std::make_shared<Wrapper>( Wrapper(zero, kid) );
+    p_zero = std::make_shared<Wrapper>( makeZero(zero) );
+}
+
+// Keys of each context, context 0 having none. The raw pointers are scanned
+// without locking; the slot owns the keys, so their address cannot be taken
+// by another key set while the context is bound.
+static std::atomic<const void *> context_keys[N_CONTEXTS];
+static std::shared_ptr<seal_wrapper::SealBFVKeys> context_owners[N_CONTEXTS];
+static std::atomic<int> n_contexts{0};
+static std::mutex context_mutex;
+
+// Frees a context whose keys are used by nothing else than its OOM table,
+// which is cleared to find out. Called with context_mutex held.
+bool Wrapper::reclaim(int c)
+{
+    if ( context_owners[c].use_count() > 1 ) caches[c].clear();
+    if ( context_owners[c].use_count() > 1 ) return false;
+    context_keys[c] = nullptr;
+    context_owners[c] = nullptr;
+    managers[c].reset();
+    return true;
+}
+
+// Index of the key context of native, which is bound to a free index the
+// first time its keys are seen. The bound contexts are few, so a scan is
+// enough to find them. Once all indices are taken, the contexts whose keys
+// are gone are freed.
+int Wrapper::keyContext(const Native & native)
+{
+    auto keys = native.getKeys();
+    int n = n_contexts.load(std::memory_order_acquire);
+    for (int c = 1; c <= n; c++)
+        if ( context_keys[c] == keys.get() ) return c;
+
+    std::lock_guard<std::mutex> lock(context_mutex);
+    n = n_contexts;
+    int free = 0;
+    for (int c = 1; c <= n; c++)
+    {
+        if ( context_keys[c] == keys.get() ) return c;
+        if ( !free && !context_owners[c] ) free = c;
+    }
+    if (!free && n + 1 < N_CONTEXTS) free = n + 1;
+    for (int c = 1; !free && c <= n; c++)
+        if ( reclaim(c) ) free = c;
+    if (!free) throw "Too many key contexts";
+
+    context_owners[free] = keys;
+    context_keys[free] = keys.get();
+    managers[free].bind(free);
+    if (free > n) n_contexts.store(free, std::memory_order_release);
+    return free;
+}
+
+// Registers zero as the zero of its key context, the ciphertext that its
+// context id refers to
+Wrapper Wrapper::makeZero(const Native & zero)
+{
+    int c = keyContext(zero);
+    Wrapper w( zero, zeroOf(c) );
+    if ( caches[c].getPolicy() == PolicyType::GreedyDualSize ) calibrateCache(zero);
+    return w;
+}
+
+// highest index of a key context bound so far, numbered from 1
+int Wrapper::nContexts()
+{
+    return n_contexts;
+}
+
+// Wraps a batch of fresh ciphertexts. Those of each key context are
+// registered under consecutive ids at once.
+std::vector<Wrapper> Wrapper::wrap(std::vector<Native> && natives)
+{
+    std::vector<std::vector<size_t>> members(N_CONTEXTS);
+    for (size_t i = 0; i < natives.size(); i++) members[keyContext(natives[i])].push_back(i);
+
+    std::vector<int> ids( natives.size() );
+    std::vector<std::shared_ptr<Native>> shared;
+    for (int c = 0; c < N_CONTEXTS; c++)
+    {
+        if ( members[c].empty() ) continue;
+        shared.clear();
+        for (auto i : members[c]) shared.push_back( makeNative( std::move(natives[i]) ) );
+        int first = managers[c].newIds(shared);
+        for (size_t k = 0; k < members[c].size(); k++) ids[ members[c][k] ] = first + int(k);
+    }
+
+    std::vector<Wrapper> v;
+    v.reserve( ids.size() );
+    for (auto id : ids) v.push_back( Wrapper(id, Adopt()) );
+    return v;
+}
+
+void relinearize(Wrapper & a)
+{
+    a.relinearize();
 }
 
 } // smart
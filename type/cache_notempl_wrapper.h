@@ -5,8 +5,53 @@
 #include <memory>
 #include <vector>
 #include "cache_entry.h"
+#include "cache_notempl_arena.h"
 #include "cache_notempl_manager.h"
 
+#ifndef CTADD
+    #define CTADD 1
+#endif
+
+#ifndef CTMUL
+    #define CTMUL 0
+#endif
+
+#ifndef CTSUB
+    #define CTSUB 0
+#endif
+
+#ifndef PTADD
+    #define PTADD 0
+#endif
+
+#ifndef PTMUL
+    #define PTMUL 1
+#endif
+
+#ifndef PTSUB
+    #define PTSUB 0
+#endif
+
+#ifndef CTROT
+    #define CTROT 1
+#endif
+
+#ifndef CTNEG
+    #define CTNEG 0
+#endif
+
+#ifndef CTPOW
+    #define CTPOW 0
+#endif
+
+#ifndef DEFER
+    #define DEFER 0
+#endif
+
+#ifndef CACHE_RESIZE
+    #define CACHE_RESIZE -1 // entries kept per thread by trimCache (-1: all)
+#endif
+
 namespace seal_wrapper
 {
     class SealBFVCiphertext;
@@ -18,28 +63,48 @@ namespace smart
 {
 
 class Cache;
+class Graph;
 
 class Wrapper
 {
     private:
         int id;
-        static Manager manager;
-        static Cache cache;
+        static Manager managers[N_CONTEXTS];
+        static Cache caches[N_CONTEXTS];
+#if (DEFER == 1)
+        static Graph graph;
+#endif
         static std::shared_ptr<Wrapper> p_zero;
 
+        struct Adopt {}; // the id's reference is already counted
+        Wrapper(const std::shared_ptr<Native> &, int context);
+        Wrapper(const Native &, int);
+        Wrapper(int aid, Adopt) : id(aid) {}
+        int context() const;
+        Native & own();
+
+        static Manager & managerOf(int id) { return managers[contextOf(id)]; }
+        static Cache & cacheOf(int id);
+        static std::shared_ptr<Native> nativeOf(int id) { return managerOf(id)[id]; }
+        static int nrefs(int id) { return managerOf(id).nrefs(id); }
+        static void retain(int id) { if (id != Manager::NONE) managerOf(id).refUp(id); }
+        static void release(int id) { if (id != Manager::NONE) managerOf(id).refDown(id); }
+        static bool reclaim(int context);
+        static void calibrateOnUse(const Native &, Operator, int s = 0);
+
     public:
         Wrapper();
         Wrapper(const Native &);
-        Wrapper(const Native &, int);
+        Wrapper(Native &&);
         Wrapper(int);
         Wrapper(const Wrapper &);
-        Wrapper(const Wrapper &&);
+        Wrapper(Wrapper &&) noexcept;
         ~Wrapper();
 
         explicit operator Native() const;
 
         Wrapper & operator=(const Wrapper &);
-        Wrapper & operator=(const Wrapper &&) noexcept;
+        Wrapper & operator=(Wrapper &&) noexcept;
 
         Wrapper & operator+=(const Wrapper &);
         Wrapper & operator*=(const Wrapper &);
@@ -47,87 +112,189 @@ class Wrapper
         Wrapper & operator+=(int);
         Wrapper & operator*=(int);
         Wrapper & operator-=(int);
+        Wrapper & operator~(); // negate_inplace
+        Wrapper & operator^=(int); // exponentation
+        Wrapper & operator<<=(int); // rotate rows left
+        Wrapper & operator>>=(int); // rotate rows right
 
-        Wrapper operator+(const Wrapper &) const;
-        Wrapper operator*(const Wrapper &) const;
-        Wrapper operator-(const Wrapper &) const;
-        Wrapper operator+(int) const;
-        Wrapper operator*(int) const;
-        Wrapper operator-(int) const;
+        Wrapper operator+(const Wrapper &) const &;
+        Wrapper operator*(const Wrapper &) const &;
+        Wrapper operator-(const Wrapper &) const &;
+        Wrapper operator+(int) const &;
+        Wrapper operator*(int) const &;
+        Wrapper operator-(int) const &;
+        Wrapper operator-() const &; // negate
+        Wrapper operator!() const; // rotate columns
+        Wrapper operator^(int) const &;
+        Wrapper operator<<(int) const &;
+        Wrapper operator>>(int) const &;
 
+        // operators on expiring wrappers, computed in place after the OOM probe
+        Wrapper operator+(const Wrapper &) &&;
+        Wrapper operator*(const Wrapper &) &&;
+        Wrapper operator-(const Wrapper &) &&;
+        Wrapper operator+(int) &&;
+        Wrapper operator*(int) &&;
+        Wrapper operator-(int) &&;
+        Wrapper operator-() &&;
+        Wrapper operator^(int) &&;
+        Wrapper operator<<(int) &&;
+        Wrapper operator>>(int) &&;
+
+#if (CTADD == 0)
+        static Wrapper add_many(const std::vector<const Wrapper *> &);
+#endif
+        static void calibrateCache(const Native &);
         static void clearCache();
         static void resizeCache(size_t size);
+        static void setCacheByteLimit(size_t bytes);
+        static void setCachePolicy(int policy);
+        static void setCacheRssLimit(size_t bytes);
+        static void setCacheSpillLimit(size_t bytes);
         static void setZero(const Native &);
+        static void trimCache();
         static std::vector<int> getCounters();
-        static const Cache & getCache() { return cache; }
-        static const Manager & getManager() { return manager; }
+        static int keyContext(const Native &);
+        static Wrapper makeZero(const Native &);
+        static int nContexts();
+        static std::vector<Wrapper> wrap(std::vector<Native> &&);
+        static Cache & getCache(int context);
+        static const Manager & getManager(int context) { return managers[context]; }
+        size_t byteSize() const;
         int getId() const;
+        void materialize() const;
+        void relinearize();
 
+        friend class Cache;
+        friend class Graph;
         friend std::ostream & operator <<(std::ostream &, const Wrapper &);
 };
 
+void relinearize(Wrapper &);
+
 inline Wrapper::Wrapper()
     : id(0)
 {
-    manager.refUp(id);
+    managerOf(id).refUp(id);
 }
 
 inline Wrapper::Wrapper(const Native & native)
-    : id( manager.newId(std::make_shared<Native>(native)) )
+    : id( managers[keyContext(native)].newId(makeNative(native)) )
+{}
+
+inline Wrapper::Wrapper(Native && native)
+    : id( managers[keyContext(native)].newId(makeNative( std::move(native) )) )
+{}
+
+inline Wrapper::Wrapper(const std::shared_ptr<Native> & native, int context)
+    : id( managers[context].newId(native) )
 {}
 
 inline Wrapper::Wrapper(const Native & native, int id)
-    : id( manager.newId(std::make_shared<Native>(native), id) )
+    : id( managerOf(id).newId(makeNative(native), id) )
 {}
 
 inline Wrapper::Wrapper(const Wrapper & a)
     : id(a.id)
 {
-    manager.refUp(id);
+    retain(id);
 }
 
 inline Wrapper::Wrapper(int aid)
     : id(aid)
 {
-    manager.refUp(id);
+    retain(id);
 }
 
-inline Wrapper::Wrapper(const Wrapper && a)
+// the moved-from wrapper holds no reference
+inline Wrapper::Wrapper(Wrapper && a) noexcept
     : id(a.id)
 {
-    manager.refUp(id);
+    a.id = Manager::NONE;
 }
 
 inline Wrapper::~Wrapper()
 {
-    manager.refDown(id);
+    release(id);
 }
 
 inline Wrapper::operator Native() const
 {
-    return *manager[id];
+    if (id == Manager::NONE) throw "Conversion of a moved-from Wrapper";
+    materialize();
+    return *nativeOf(id);
 }
 
 inline Wrapper & Wrapper::operator =(const Wrapper & a)
 {
     if (id != a.id)
     {
-        manager.refDown(id);
+        release(id);
         id = a.id;
-        manager.refUp(id);
+        retain(id);
     }
     return *this;
 }
 
-inline Wrapper & Wrapper::operator =(const Wrapper && a) noexcept
+inline Wrapper & Wrapper::operator =(Wrapper && a) noexcept
 {
-    if (id != a.id)
+    if (this != &a)
     {
-        manager.refDown(id);
+        release(id);
         id = a.id;
-        manager.refUp(id);
+        a.id = Manager::NONE;
     }
     return *this;
 }
 
+inline Wrapper Wrapper::operator +(const Wrapper & a) &&
+{
+    return std::move(*this += a);
+}
+
+inline Wrapper Wrapper::operator *(const Wrapper & a) &&
+{
+    return std::move(*this *= a);
+}
+
+inline Wrapper Wrapper::operator -(const Wrapper & a) &&
+{
+    return std::move(*this -= a);
+}
+
+inline Wrapper Wrapper::operator +(int a) &&
+{
+    return std::move(*this += a);
+}
+
+inline Wrapper Wrapper::operator *(int a) &&
+{
+    return std::move(*this *= a);
+}
+
+inline Wrapper Wrapper::operator -(int a) &&
+{
+    return std::move(*this -= a);
+}
+
+inline Wrapper Wrapper::operator -() &&
+{
+    return std::move(~*this);
+}
+
+inline Wrapper Wrapper::operator ^(int e) &&
+{
+    return std::move(*this ^= e);
+}
+
+inline Wrapper Wrapper::operator <<(int s) &&
+{
+    return std::move(*this <<= s);
+}
+
+inline Wrapper Wrapper::operator >>(int s) &&
+{
+    return std::move(*this >>= s);
+}
+
 } // smart